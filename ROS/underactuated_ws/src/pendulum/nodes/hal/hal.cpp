@@ -5,39 +5,7 @@
 #include "gazebo_msgs/ModelState.h"
 #include <cmath>
 #include <mutex>
-
-static int squirrelNoise(int position, int seed = 0)
-{
-    constexpr unsigned int BIT_NOISE1 = 0xB5297A4D;
-    constexpr unsigned int BIT_NOISE2 = 0x68E31DA4;
-    constexpr unsigned int BIT_NOISE3 = 0x1B56C4E9;
-
-    int mangled = position;
-    mangled *= BIT_NOISE1;
-    mangled += seed;
-    mangled ^= (mangled >> 8);
-    mangled *= BIT_NOISE2;
-    mangled ^= (mangled << 8);
-    mangled *= BIT_NOISE3;
-    mangled ^= (mangled >> 8);
-    return mangled;
-}
-
-struct squirrelRng
-{
-    int rand()
-    {
-        return squirrelNoise(state++);
-    }
-
-    float uniform()
-    {
-        auto i = rand();
-        return float(i & ((1 << 24) - 1)) / (1 << 24);
-    }
-
-    int state = 0;
-};
+#include <math/noise.h>
 
 struct Pendulum
 {
@@ -56,7 +24,7 @@ struct Pendulum
             I1 = m1 * l1 * l1 / 3;
         }
         
-        void randomize(squirrelRng& rng)
+        void randomize(math::SquirrelRng& rng)
         {
             l1 = rng.uniform() * 10;
             m1 = rng.uniform() * 10;
@@ -70,12 +38,12 @@ struct Pendulum
         double theta = 0;
         double dTheta = 0;
 
-        void perturbate(squirrelRng& rng)
+        void perturbate(math::SquirrelRng& rng)
         {
             dTheta += rng.uniform() - 0.5;
         }
         
-        void randomize(squirrelRng& rng)
+        void randomize(math::SquirrelRng& rng)
         {
             theta = rng.uniform() * 2 * 3.1415927;
         }
@@ -115,7 +83,8 @@ int main(int argc, char **argv)
     auto statePublisher = nodeHandle.advertise<StateMsg>("pendulum_x", cQueueSize);
 
     // Initialize a pendulum
-    squirrelRng rng;
+    math::SquirrelRng rng;
+    rng.m_state = -1; // Pre-increments, so the sequence still starts at position 0
     rng.rand(); // Seed random number generator
     Pendulum pendulum;
     pendulum.m_params.randomize(rng);
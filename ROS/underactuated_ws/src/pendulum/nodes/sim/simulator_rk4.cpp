@@ -7,6 +7,11 @@
 #include <mutex>
 #include <cstdlib>
 #include <ctime>
+#include <math/fastTrig.h>
+
+// Set to true to integrate with the polynomial approximations in math/fastTrig.h instead of libm
+static constexpr bool kFastTrig = false;
+using ModelTrig = math::Trig<kFastTrig>;
 
 constexpr double PI = 3.14159265358979323;
 
@@ -42,14 +47,14 @@ struct Pendulum
     {
         State nextState;
         nextState.theta  = state.dTheta;
-        nextState.dTheta = -g/m_params.l1 * std::sin(state.theta) + 
+        nextState.dTheta = -g/m_params.l1 * ModelTrig::sin(state.theta) + 
                            (u-m_params.b1*state.dTheta)/(m_params.m1*m_params.l1*m_params.l1);
         return nextState;
     }
     void stepSimulation(double stepDt, double u)
     {
         const auto T = 0.5 * m_params.m1 * m_params.l1 * m_params.l1 * m_state.dTheta * m_state.dTheta;
-        const auto V = m_params.m1 * g * m_params.l1 * -std::cos(m_state.theta) + m_params.m1 * g * m_params.l1;
+        const auto V = m_params.m1 * g * m_params.l1 * -ModelTrig::cos(m_state.theta) + m_params.m1 * g * m_params.l1;
         const auto E = T + V;
 
         ROS_INFO("E: %f, U: %f", E, u);
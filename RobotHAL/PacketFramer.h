@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+
+// Splits a serial byte stream into packets:
+//   header (0x55), payload size, payload, checksum (xor of the size and payload bytes).
+// Received bytes are written in bulk into a ring buffer, and each call to extract emits every
+// complete packet in it. Corrupt or truncated packets are skipped by searching for the next header.
+// The payloads exchanged with the robot are described in RobotProtocol.h.
+class PacketFramer
+{
+public:
+	static constexpr uint8_t HEADER = 0x55;
+	static constexpr int MAX_PAYLOAD = 255;
+	static constexpr int MAX_PACKET = MAX_PAYLOAD + 3;
+
+	// Payloads longer than maxPayload are rejected as soon as their size byte arrives, instead of
+	// waiting for the whole false packet.
+	explicit PacketFramer(int maxPayload = MAX_PAYLOAD)
+		: m_maxPayload(maxPayload)
+	{}
+
+	// Contiguous free space, for reading from the port. Commit the bytes read with produce.
+	uint8_t* writeSpan(int& size)
+	{
+		const unsigned pos = m_tail & MASK;
+		const unsigned free = BUFFER_SIZE - (m_tail - m_head);
+		size = int(free < BUFFER_SIZE - pos ? free : BUFFER_SIZE - pos);
+		return &m_buffer[pos];
+	}
+
+	void produce(int numBytes) { m_tail += numBytes; }
+
+	// Writes a whole packet around the payload into dst, which needs room for size + 3 bytes.
+	// Returns the packet size.
+	static int encode(const uint8_t* payload, int size, uint8_t* dst)
+	{
+		dst[0] = HEADER;
+		dst[1] = uint8_t(size);
+		uint8_t crc = uint8_t(size);
+		for (int i = 0; i < size; ++i)
+		{
+			dst[i + 2] = payload[i];
+			crc ^= payload[i];
+		}
+		dst[size + 2] = crc;
+		return size + 3;
+	}
+
+	// Calls onPacket(const uint8_t* payload, int size) for each complete valid packet, and keeps
+	// any incomplete packet for later. Returns the number of packets emitted.
+	template<class Callback>
+	int extract(Callback&& onPacket)
+	{
+		int numPackets = 0;
+		for (;;)
+		{
+			// Resync
+			while (m_head != m_tail && at(0) != HEADER)
+			{
+				++m_head;
+				++m_droppedBytes;
+			}
+			const unsigned available = m_tail - m_head;
+			if (available < 2)
+				break;
+
+			const uint8_t size = at(1);
+			if (size > m_maxPayload)
+			{
+				++m_head; // Not a real header
+				++m_droppedBytes;
+				continue;
+			}
+			if (available < unsigned(size) + 3)
+				break;
+
+			uint8_t crc = size;
+			for (int i = 0; i < size; ++i)
+			{
+				m_packet[i] = at(i + 2);
+				crc ^= m_packet[i];
+			}
+			if (crc != at(size + 2))
+			{
+				// The header may have been a payload byte, search again from the next one
+				++m_head;
+				++m_droppedBytes;
+				++m_checksumErrors;
+				continue;
+			}
+
+			m_head += size + 3;
+			++numPackets;
+			onPacket(static_cast<const uint8_t*>(m_packet), int(size));
+		}
+		return numPackets;
+	}
+
+	int checksumErrors() const { return m_checksumErrors; }
+	int droppedBytes() const { return m_droppedBytes; }
+
+private:
+	// Big enough to hold several packets, so one read can bring in many of them
+	static constexpr unsigned BUFFER_SIZE = 1024;
+	static constexpr unsigned MASK = BUFFER_SIZE - 1;
+	static_assert((BUFFER_SIZE & MASK) == 0 && BUFFER_SIZE >= 2 * MAX_PACKET, "Bad framer buffer size");
+
+	uint8_t at(unsigned i) const { return m_buffer[(m_head + i) & MASK]; }
+
+	int m_maxPayload;
+	uint8_t m_buffer[BUFFER_SIZE] = {};
+	unsigned m_head = 0; // Free running counters
+	unsigned m_tail = 0;
+
+	alignas(8) uint8_t m_packet[MAX_PAYLOAD] = {}; // Contiguous copy of the current payload
+
+	int m_checksumErrors = 0;
+	int m_droppedBytes = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "PacketFramer.h"
+#include "RobotHAL.h"
+#include <cstdint>
+
+// Payloads of the PacketFramer packets exchanged with the robot. This is the wire format: fields
+// are little endian and packed, independent of how the compiler lays out ActuatorState.
+//
+// State, robot to host. One 7 byte record per actuator:
+//   uint8 id, uint16 position, uint16 velocity, uint16 torque
+// Torques, host to robot. Actuators with contiguous ids, starting at id0:
+//   uint8 id0, then one uint16 torque per actuator
+namespace RobotProtocol
+{
+	constexpr int STATE_RECORD_SIZE = 7;
+	constexpr int MAX_STATES_PER_PACKET = PacketFramer::MAX_PAYLOAD / STATE_RECORD_SIZE;
+	constexpr int MAX_TORQUES_PER_PACKET = (PacketFramer::MAX_PAYLOAD - 1) / 2;
+
+	inline uint16_t readU16(const uint8_t* src) { return uint16_t(src[0] | (src[1] << 8)); }
+
+	inline void writeU16(uint16_t value, uint8_t* dst)
+	{
+		dst[0] = uint8_t(value & 0xff);
+		dst[1] = uint8_t(value >> 8);
+	}
+
+	// Returns the number of actuators written to dst, or -1 when the payload isn't a whole number
+	// of records, is empty, or holds more than maxActuators.
+	inline int decodeState(const uint8_t* payload, int size, RobotHAL::ActuatorState* dst, int maxActuators)
+	{
+		const int numActuators = size / STATE_RECORD_SIZE;
+		if (size <= 0 || size % STATE_RECORD_SIZE != 0 || numActuators > maxActuators)
+			return -1;
+		for (int i = 0; i < numActuators; ++i)
+		{
+			const uint8_t* record = payload + i * STATE_RECORD_SIZE;
+			dst[i].id = record[0];
+			dst[i].position = readU16(record + 1);
+			dst[i].velocity = readU16(record + 3);
+			dst[i].torque = readU16(record + 5);
+		}
+		return numActuators;
+	}
+
+	// numTorques must be at most MAX_TORQUES_PER_PACKET. Returns the payload size.
+	inline int encodeTorques(uint8_t id0, const uint16_t* torques, int numTorques, uint8_t* dst)
+	{
+		dst[0] = id0;
+		for (int i = 0; i < numTorques; ++i)
+			writeU16(torques[i], dst + 1 + 2 * i);
+		return 1 + 2 * numTorques;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Latest value slot for one writer thread and any number of readers.
+// Writes never wait. Reads never block the writer, and retry if a write overlapped them.
+// The value is stored as atomic words, so readers racing with the writer are well defined.
+template<class T>
+class SeqLock
+{
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied as raw words");
+
+	// Writer side
+	void store(const T& value)
+	{
+		uint64_t words[NUM_WORDS] = {};
+		std::memcpy(words, &value, sizeof(T));
+
+		const uint64_t seq = m_seq.load(std::memory_order_relaxed);
+		m_seq.store(seq + 1, std::memory_order_relaxed); // Odd: write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < NUM_WORDS; ++i)
+			m_words[i].store(words[i], std::memory_order_relaxed);
+		m_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	// Single attempt. Returns false if nothing was stored yet, or a write was in progress.
+	bool tryLoad(T& value) const
+	{
+		const uint64_t seq = m_seq.load(std::memory_order_acquire);
+		if (seq == 0 || (seq & 1))
+			return false;
+
+		uint64_t words[NUM_WORDS];
+		for (size_t i = 0; i < NUM_WORDS; ++i)
+			words[i] = m_words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_seq.load(std::memory_order_relaxed) != seq)
+			return false;
+
+		std::memcpy(&value, words, sizeof(T));
+		return true;
+	}
+
+	// Retries until it gets a consistent copy. Returns false if nothing was stored yet.
+	bool load(T& value) const
+	{
+		while (!tryLoad(value))
+		{
+			if (version() == 0)
+				return false;
+		}
+		return true;
+	}
+
+	// Number of values stored so far
+	uint64_t version() const { return m_seq.load(std::memory_order_acquire) / 2; }
+
+private:
+	static constexpr size_t NUM_WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint64_t> m_seq = 0;
+	std::atomic<uint64_t> m_words[NUM_WORDS] = {};
+};
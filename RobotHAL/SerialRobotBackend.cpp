@@ -27,72 +27,128 @@ SerialRobotBackend::~SerialRobotBackend()
 }
 
 //-------------------------------------------------------------------------------------------------
-void SerialRobotBackend::readDataByte()
+void SerialRobotBackend::receive()
 {
-	switch (m_processorState)
-	{
-	case Empty:
-	{
-		uint8_t dataByte = m_comm->read();
-		if (dataByte == PACKET_HEADER)
-			m_processorState = HaveHeader;
-		break;
-	}
-	case HaveHeader:
-		m_readBuffer[0] = m_comm->read();
-		m_processorState = HaveSize;
-		break;
-	case HaveSize:
-		m_comm->read(m_readBuffer + 1, m_readBuffer[0]);
-		m_processorState = HaveData;
-		break;
-	case HaveData:
-		uint8_t crc = m_readBuffer[0];
-		for (uint8_t i = 0; i < m_readBuffer[0]; ++i)
-		{
-			crc ^= m_readBuffer[i + 1];
-		}
-		uint8_t readCrc = m_comm->read();
-		if (readCrc == crc)
-		{
-			m_haveValidPacket = true;
-		}
-		m_processorState = Empty;
-		break;
-	}
+	// Take everything the port has in one read, and process all the packets it completes
+	int space;
+	uint8_t* dst = m_framer.writeSpan(space);
+	const unsigned numBytes = m_comm->read(dst, space);
+	if (!numBytes)
+		return; // Timed out
+	m_framer.produce(numBytes);
+
+	m_framer.extract([this](const uint8_t* payload, int size) {
+		processReceivedPacket(payload, size);
+	});
 }
 
 //-------------------------------------------------------------------------------------------------
 void SerialRobotBackend::init(const char* serialPortName)
 {
-	assert(m_onStateRead);
 	// Open serial port
 	m_comm = new Serial(serialPortName, 9600);
+	m_comm->setReadTimeout(READ_TIMEOUT_MS);
 
-	// Start reading thread
+	// Start communication thread.
+	// Writes go out from this same thread, between reads: synchronous I/O on a port handle is
+	// serialized anyway, so a separate writer thread would still wait for reads to time out.
+	// Reads give up after READ_TIMEOUT_MS without data, which bounds how long a torque written
+	// while the robot is silent waits to be sent.
 	m_commThread = std::thread([this]() {
 		while (!m_mustClose)
 		{
-			readDataByte();
-			if (m_haveValidPacket)
-			{
-				processReceivedPacket();
-			}
+			transmit();
+			receive();
 		}
 	});
 }
 
 //-------------------------------------------------------------------------------------------------
-void SerialRobotBackend::processReceivedPacket()
+void SerialRobotBackend::processReceivedPacket(const uint8_t* payload, int size)
 {
-	assert(m_haveValidPacket);
-	m_haveValidPacket = false;
-	uint8_t numActuators = m_readBuffer[0] / 3;
+	// Decode the state out of the receive buffer, so consumers can keep it.
+	// Packets that aren't a whole number of actuators passed the checksum by chance, or come from a
+	// mismatched firmware, and can't be split into actuators.
+	StateSnapshot& state = m_receivedState;
+	const int numActuators = RobotProtocol::decodeState(payload, size, state.actuators, MAX_ACTUATORS);
+	if (numActuators < 0)
+	{
+		++m_malformedPackets;
+		return;
+	}
+	state.timestamp = std::chrono::steady_clock::now();
+	state.numActuators = numActuators;
 
-	auto actuators = reinterpret_cast<ActuatorState*>(&m_readBuffer[1]);
+	m_latestState.store(state);
+	if (!m_stateQueue.push(state))
+		++m_droppedStates;
 
 	if (m_onStateRead)
 	{
-		m_onStateRead(this, numActuators, actuators);
+		m_onStateRead(this, state.numActuators, state.actuators);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+void SerialRobotBackend::writeTorque(int numActuators, int actuatorId0, uint16_t* torqueArray)
+{
+	// Ids past the end would write outside the command buffers. Reject the whole call in release
+	// builds too, rather than sending part of it.
+	const bool validRange = actuatorId0 >= 0 && actuatorId0 <= MAX_ACTUATOR_ID
+		&& numActuators >= 0 && numActuators <= MAX_ACTUATOR_ID + 1 - actuatorId0;
+	assert(validRange && (torqueArray || !numActuators));
+	if (!validRange || (!torqueArray && numActuators))
+	{
+		++m_rejectedTorques;
+		return;
 	}
-}
\ No newline at end of file
+
+	std::lock_guard<std::mutex> lock(m_torqueMutex);
+	TorqueCommands& commands = *m_pendingTorques;
+	int coalesced = 0;
+	for (int i = 0; i < numActuators; ++i)
+	{
+		const int id = actuatorId0 + i;
+		coalesced += commands.dirty[id];
+		commands.torque[id] = torqueArray[i];
+		commands.dirty[id] = true;
+	}
+	commands.any = commands.any || numActuators > 0;
+	if (coalesced)
+		m_coalescedTorques += coalesced;
+}
+
+//-------------------------------------------------------------------------------------------------
+void SerialRobotBackend::transmit()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_torqueMutex);
+		if (!m_pendingTorques->any)
+			return;
+		std::swap(m_pendingTorques, m_sendingTorques);
+	}
+
+	// One packet per run of contiguous actuator ids, all in a single write
+	TorqueCommands& commands = *m_sendingTorques;
+	uint8_t payload[PacketFramer::MAX_PAYLOAD];
+	int txSize = 0;
+	for (int id = 0; id <= MAX_ACTUATOR_ID;)
+	{
+		if (!commands.dirty[id])
+		{
+			++id;
+			continue;
+		}
+		const int id0 = id;
+		while (id <= MAX_ACTUATOR_ID && commands.dirty[id] && id - id0 < RobotProtocol::MAX_TORQUES_PER_PACKET)
+		{
+			commands.dirty[id] = false;
+			++id;
+		}
+		const int size = RobotProtocol::encodeTorques(uint8_t(id0), &commands.torque[id0], id - id0, payload);
+		txSize += PacketFramer::encode(payload, size, &m_txBuffer[txSize]);
+	}
+	commands.any = false;
+
+	m_comm->write(m_txBuffer, txSize);
+}
@@ -1,6 +1,13 @@
 #pragma once
 
+#include "PacketFramer.h"
 #include "RobotHAL.h"
+#include "RobotProtocol.h"
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <thread>
 
 class Serial;
@@ -8,42 +15,82 @@ class Serial;
 class SerialRobotBackend : public RobotHAL
 {
 public:
+	// Packet contents are described in RobotProtocol.h
+	static constexpr int MAX_ACTUATORS = RobotProtocol::MAX_STATES_PER_PACKET;
+	static constexpr int MAX_ACTUATOR_ID = 255;
+
+	// State of the robot as received in one packet
+	struct StateSnapshot
+	{
+		std::chrono::steady_clock::time_point timestamp; // Reception time
+		int numActuators = 0;
+		ActuatorState actuators[MAX_ACTUATORS];
+	};
+
 	SerialRobotBackend();
 	~SerialRobotBackend();
 
 	void init(const char* serialPortName);
 
+	// Never blocks on the port. Commands are sent by the comm thread, and when they come in faster
+	// than the link can take them, only the latest torque of each actuator is sent.
 	void writeTorque(int numActuators, int actuatorId0, uint16_t* torqueArray) override;
+	int coalescedTorques() const { return m_coalescedTorques; } // Commands replaced before being sent
+	int rejectedTorques() const { return m_rejectedTorques; } // Calls with actuator ids out of range
 	void onStateRead(const StateReadDelegate& cb) override
 	{
 		m_onStateRead = cb;
 	}
 
+	// Polling alternative to onStateRead, for a control loop running on its own thread.
+	// Neither call blocks, and both may be used from the same consumer thread.
+	// Oldest snapshot not popped yet. Snapshots are dropped while the queue is full.
+	bool popState(StateSnapshot& snapshot) { return m_stateQueue.pop(snapshot); }
+	// Most recent snapshot. Returns false until the first packet arrives.
+	bool latestState(StateSnapshot& snapshot) const { return m_latestState.load(snapshot); }
+	int droppedStates() const { return m_droppedStates; }
+	int malformedPackets() const { return m_malformedPackets; } // Rejected for their size
+
 private:
-	void readDataByte();
-	void processReceivedPacket();
+	void receive();
+	void processReceivedPacket(const uint8_t* payload, int size);
+	void transmit();
 
 private:
 	StateReadDelegate m_onStateRead;
 	Serial* m_comm = nullptr;
 	std::thread m_commThread;
-	bool m_mustClose = false;
+	std::atomic<bool> m_mustClose = false;
 
-	static constexpr int READ_BUFFER_SIZE = 256;
-	uint8_t m_readBuffer[READ_BUFFER_SIZE] = {};
-	int m_writePos = 0;
-	int m_readPos = 0;
+	PacketFramer m_framer{ MAX_ACTUATORS * RobotProtocol::STATE_RECORD_SIZE }; // Only state packets come in
 
-	bool m_haveValidPacket = false;
+	// Written by the comm thread only
+	SpscQueue<StateSnapshot, 64> m_stateQueue;
+	SeqLock<StateSnapshot> m_latestState;
+	std::atomic<int> m_droppedStates = 0;
+	std::atomic<int> m_malformedPackets = 0;
+	StateSnapshot m_receivedState;
 
-	static constexpr uint8_t PACKET_HEADER = 0x55;
-	enum PackedProcessorState
+	// Torque commands, double buffered. writeTorque fills the back buffer, and the comm thread swaps
+	// it with the front one before sending, so the lock is never held during I/O.
+	struct TorqueCommands
 	{
-		Empty,
-		HaveHeader,
-		HaveSize,
-		HaveData
+		uint16_t torque[MAX_ACTUATOR_ID + 1] = {};
+		bool dirty[MAX_ACTUATOR_ID + 1] = {};
+		bool any = false;
 	};
+	TorqueCommands m_torqueBuffers[2];
+	TorqueCommands* m_pendingTorques = &m_torqueBuffers[0]; // Guarded by m_torqueMutex
+	TorqueCommands* m_sendingTorques = &m_torqueBuffers[1]; // Comm thread only
+	std::mutex m_torqueMutex;
+	std::atomic<int> m_coalescedTorques = 0;
+	std::atomic<int> m_rejectedTorques = 0;
+
+	// Longest a torque command waits for a read to return before being sent, when no state comes in.
+	// Windows rounds it up to the system timer period: 1ms after timeBeginPeriod(1), 15.6ms by default.
+	static constexpr unsigned READ_TIMEOUT_MS = 1;
 
-	PackedProcessorState m_processorState = Empty;
+	// Each torque takes 2 bytes, plus at most the 4 bytes of overhead of a packet of its own
+	static constexpr int TX_BUFFER_SIZE = (MAX_ACTUATOR_ID + 1) * 6;
+	uint8_t m_txBuffer[TX_BUFFER_SIZE] = {};
 };
@@ -11,9 +11,11 @@ public:
 	unsigned	write(const void* _src, unsigned _nBytes);
 	bool		write(uint8_t);
 
-	unsigned	read(void* _dst, unsigned _nBytes);
+	unsigned	read(void* _dst, unsigned _nBytes); // Returns the bytes available, up to _nBytes. 0 on timeout
 	uint8_t		read();
 
+	void		setReadTimeout(unsigned _ms); // How long reads wait for the first byte. 100ms by default.
+
 
 protected:
 	SerialWin32(const char* _port, unsigned _baudRate);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Wait-free queue for exactly one producer thread and one consumer thread.
+// Values are copied in and out, so the producer can reuse its buffers as soon as push returns.
+template<class T, size_t Capacity>
+class SpscQueue
+{
+public:
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	// Producer side. Returns false, without blocking, when the queue is full.
+	bool push(const T& value)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_headCache == Capacity)
+		{
+			m_headCache = m_head.load(std::memory_order_acquire);
+			if (tail - m_headCache == Capacity)
+				return false;
+		}
+		m_slots[tail & MASK] = value;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false, without blocking, when the queue is empty.
+	bool pop(T& value)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tailCache)
+		{
+			m_tailCache = m_tail.load(std::memory_order_acquire);
+			if (head == m_tailCache)
+				return false;
+		}
+		value = m_slots[head & MASK];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Approximate when called while the other thread is running
+	size_t size() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+
+private:
+	static constexpr size_t MASK = Capacity - 1;
+	static constexpr size_t CACHE_LINE = 64;
+
+	// Each side owns a cache line, with its own index and a cached copy of the other side's index,
+	// so they only touch each other's line when the cached copy says the queue is full or empty.
+	alignas(CACHE_LINE) std::atomic<size_t> m_head = 0;
+	size_t m_tailCache = 0; // Consumer's view of m_tail
+	alignas(CACHE_LINE) std::atomic<size_t> m_tail = 0;
+	size_t m_headCache = 0; // Producer's view of m_head
+	alignas(CACHE_LINE) T m_slots[Capacity];
+};
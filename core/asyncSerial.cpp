@@ -0,0 +1,472 @@
+#if defined(__linux__)
+
+extern "C" {
+	#include <fcntl.h>
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "asyncSerial.h"
+#include "serial.h"
+
+//------------------------------------------------------------------------------------------------------------------
+ByteRing::ByteRing(size_t _capacity)
+{
+	size_t capacity = 1;
+	while (capacity < _capacity)
+		capacity <<= 1;
+	mData.resize(capacity);
+	mMask = capacity - 1;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+size_t ByteRing::peek(void* _dst, size_t _nBytes) const
+{
+	uint8_t* ptr[2];
+	size_t len[2];
+	const int numSpans = readable(ptr, len);
+	auto dst = static_cast<uint8_t*>(_dst);
+	size_t copied = 0;
+	for (int i = 0; i < numSpans && copied < _nBytes; ++i)
+	{
+		const size_t n = std::min(len[i], _nBytes - copied);
+		memcpy(dst + copied, ptr[i], n);
+		copied += n;
+	}
+	return copied;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+size_t ByteRing::read(void* _dst, size_t _nBytes)
+{
+	const size_t n = peek(_dst, _nBytes);
+	mHead += n;
+	return n;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void ByteRing::discard(size_t _nBytes)
+{
+	assert(_nBytes <= size());
+	mHead += _nBytes;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+bool ByteRing::write(const void* _src, size_t _nBytes)
+{
+	if (_nBytes > space())
+		return false;
+	uint8_t* ptr[2];
+	size_t len[2];
+	const int numSpans = writable(ptr, len);
+	auto src = static_cast<const uint8_t*>(_src);
+	size_t copied = 0;
+	for (int i = 0; i < numSpans && copied < _nBytes; ++i)
+	{
+		const size_t n = std::min(len[i], _nBytes - copied);
+		memcpy(ptr[i], src + copied, n);
+		copied += n;
+	}
+	mTail += _nBytes;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+int ByteRing::readable(uint8_t* _ptr[2], size_t _len[2]) const
+{
+	const size_t n = size();
+	if (!n)
+		return 0;
+	const size_t start = mHead & mMask;
+	const size_t first = std::min(n, capacity() - start);
+	_ptr[0] = const_cast<uint8_t*>(&mData[start]);
+	_len[0] = first;
+	if (first == n)
+		return 1;
+	_ptr[1] = const_cast<uint8_t*>(&mData[0]);
+	_len[1] = n - first;
+	return 2;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+int ByteRing::writable(uint8_t* _ptr[2], size_t _len[2])
+{
+	const size_t n = space();
+	if (!n)
+		return 0;
+	const size_t start = mTail & mMask;
+	const size_t first = std::min(n, capacity() - start);
+	_ptr[0] = &mData[start];
+	_len[0] = first;
+	if (first == n)
+		return 1;
+	_ptr[1] = &mData[0];
+	_len[1] = n - first;
+	return 2;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+SerialIOService::SerialIOService()
+{
+	mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mEpollFd < 0 || mWakeFd < 0)
+	{
+		std::cout << "Error: Unable to create the serial I/O service (" << strerror(errno) << ")\n";
+		if (mEpollFd >= 0)
+			::close(mEpollFd);
+		if (mWakeFd >= 0)
+			::close(mWakeFd);
+		mEpollFd = mWakeFd = -1;
+		return;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = nullptr; // The wake up descriptor
+	epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+
+	mThread = std::thread([this]() { run(); });
+}
+
+//------------------------------------------------------------------------------------------------------------------
+SerialIOService::~SerialIOService()
+{
+	if (mThread.joinable())
+	{
+		mMustClose = true;
+		wake();
+		mThread.join();
+	}
+	if (mEpollFd >= 0)
+		::close(mEpollFd);
+	if (mWakeFd >= 0)
+		::close(mWakeFd);
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::add(AsyncSerialPort* _port)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = _port;
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, _port->mFileDesc, &event) != 0)
+	{
+		std::cout << "Error: Unable to register serial port (" << strerror(errno) << ")\n";
+		return;
+	}
+	_port->mRegistered = true;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::remove(AsyncSerialPort* _port)
+{
+	// Events for the port may already be queued in the I/O thread's current batch, so it is the
+	// one that forgets the port, once the batch is done
+	epoll_ctl(mEpollFd, EPOLL_CTL_DEL, _port->mFileDesc, nullptr);
+	if (!mThread.joinable())
+		return;
+
+	std::unique_lock lock(mRequestMutex);
+	if (mStopped)
+		return; // No callback will run again
+	mPendingRemoval.push_back(_port);
+	if (isIOThread())
+		return; // Handled at the end of this batch
+	const uint64_t ticket = ++mRemovalsRequested;
+	wake();
+	mRemoved.wait(lock, [&]() { return mRemovalsDone >= ticket || mStopped; });
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::requestFlush(AsyncSerialPort* _port)
+{
+	{
+		std::lock_guard lock(mRequestMutex);
+		mPendingFlush.push_back(_port);
+	}
+	wake();
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::setWriteInterest(AsyncSerialPort* _port, bool _enable)
+{
+	if (_port->mWriteArmed == _enable)
+		return;
+	epoll_event event = {};
+	event.events = EPOLLIN | (_enable ? uint32_t(EPOLLOUT) : 0u);
+	event.data.ptr = _port;
+	epoll_ctl(mEpollFd, EPOLL_CTL_MOD, _port->mFileDesc, &event);
+	_port->mWriteArmed = _enable;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::wake()
+{
+	const uint64_t one = 1;
+	[[maybe_unused]] auto n = ::write(mWakeFd, &one, sizeof(one));
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::run()
+{
+	constexpr int kMaxEvents = 64;
+	epoll_event events[kMaxEvents];
+	while (!mMustClose)
+	{
+		const int numEvents = epoll_wait(mEpollFd, events, kMaxEvents, -1);
+		if (numEvents < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			std::cout << "Error: Serial I/O service failed (" << strerror(errno) << ")\n";
+			break;
+		}
+
+		for (int i = 0; i < numEvents; ++i)
+		{
+			auto port = static_cast<AsyncSerialPort*>(events[i].data.ptr);
+			if (!port)
+			{
+				uint64_t count;
+				[[maybe_unused]] auto n = ::read(mWakeFd, &count, sizeof(count));
+				continue;
+			}
+			if (!port->mRegistered)
+				continue; // Closed by an earlier callback of this batch
+
+			const uint32_t flags = events[i].events;
+			if (flags & EPOLLIN)
+				port->handleReadable();
+			if ((flags & EPOLLOUT) && port->mRegistered)
+				port->handleWritable();
+			if ((flags & (EPOLLERR | EPOLLHUP)) && port->mRegistered)
+				port->handleError(EIO);
+		}
+		processRequests();
+	}
+
+	// Don't leave anybody waiting on a removal, now or later
+	std::lock_guard lock(mRequestMutex);
+	mStopped = true;
+	mRemovalsDone = mRemovalsRequested;
+	mRemoved.notify_all();
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialIOService::processRequests()
+{
+	std::vector<AsyncSerialPort*> flush;
+	{
+		std::lock_guard lock(mRequestMutex);
+		flush.swap(mPendingFlush);
+		// Removed ports may still have a flush queued
+		for (auto* port : mPendingRemoval)
+			flush.erase(std::remove(flush.begin(), flush.end(), port), flush.end());
+		if (!mPendingRemoval.empty())
+		{
+			mPendingRemoval.clear();
+			mRemovalsDone = mRemovalsRequested;
+			mRemoved.notify_all();
+		}
+	}
+	for (auto* port : flush)
+	{
+		if (port->mRegistered)
+			port->handleWritable();
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------
+AsyncSerialPort::AsyncSerialPort(SerialIOService& _service, const char* _port, unsigned _baudRate, size_t _rxCapacity, size_t _txCapacity)
+	: mService(_service)
+	, mRx(_rxCapacity)
+	, mTx(_txCapacity)
+{
+	assert(nullptr != _port && '\0' != _port[0]);
+
+	mFileDesc = ::open(_port, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (mFileDesc < 0)
+	{
+		std::cout << "Error: Unable to access file " << _port << " (" << strerror(errno) << ")\n";
+		return;
+	}
+	if (!configureSerialPort(mFileDesc, _baudRate, false, &mBaudRate))
+	{
+		std::cout << "Error: Unable to configure serial port " << _port << "\n";
+		::close(mFileDesc);
+		mFileDesc = -1;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------
+AsyncSerialPort::~AsyncSerialPort()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void AsyncSerialPort::start()
+{
+	assert(mOnData); // Received data would pile up otherwise
+	if (!isOpen() || mRegistered || !mService.isRunning())
+		return;
+	mService.add(this);
+
+	// Data written before starting
+	bool flush;
+	{
+		std::lock_guard lock(mTxMutex);
+		flush = !mTx.empty() && !mFlushQueued;
+		mFlushQueued = mFlushQueued || flush;
+	}
+	if (flush && mRegistered)
+		mService.requestFlush(this);
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void AsyncSerialPort::close()
+{
+	// A failed port was already unregistered by the I/O thread, but the batch that failed it may
+	// still be running. Removing it again waits for that batch too.
+	bool failed;
+	{
+		std::lock_guard lock(mTxMutex);
+		failed = mFailed;
+	}
+	if (mRegistered || failed)
+	{
+		mRegistered = false;
+		mService.remove(this);
+	}
+	// Writers check the descriptor under the same lock
+	std::lock_guard lock(mTxMutex);
+	if (mFileDesc >= 0)
+	{
+		::close(mFileDesc);
+		mFileDesc = -1;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------------
+bool AsyncSerialPort::write(const void* _src, size_t _nBytes)
+{
+	assert(nullptr != _src);
+	bool flush = false;
+	{
+		std::lock_guard lock(mTxMutex);
+		if (!isOpen() || mFailed || !mTx.write(_src, _nBytes))
+			return false;
+		// One wake up per batch of writes, until the I/O thread picks them up
+		flush = !mFlushQueued && mRegistered;
+		mFlushQueued = mFlushQueued || flush;
+	}
+	if (flush)
+		mService.requestFlush(this);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+size_t AsyncSerialPort::writeSpace() const
+{
+	std::lock_guard lock(mTxMutex);
+	return mTx.space();
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void AsyncSerialPort::handleReadable()
+{
+	uint8_t* ptr[2];
+	size_t len[2];
+	const int numSpans = mRx.writable(ptr, len);
+	if (!numSpans)
+	{
+		// The consumer left the buffer full. Drop it, rather than spinning on a readable port.
+		++mOverflows;
+		mRx.clear();
+		return;
+	}
+
+	iovec iov[2];
+	for (int i = 0; i < numSpans; ++i)
+		iov[i] = { ptr[i], len[i] };
+	const ssize_t n = ::readv(mFileDesc, iov, numSpans);
+	if (n < 0)
+	{
+		if (errno != EAGAIN && errno != EINTR)
+			handleError(errno);
+		return;
+	}
+	if (n == 0)
+		return;
+
+	mRx.produce(size_t(n));
+	mOnData(mRx);
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void AsyncSerialPort::handleWritable()
+{
+	// Producers only append, so the queued bytes can be written without holding the lock
+	uint8_t* ptr[2];
+	size_t len[2];
+	int numSpans;
+	{
+		std::lock_guard lock(mTxMutex);
+		mFlushQueued = false;
+		numSpans = mTx.readable(ptr, len);
+	}
+
+	size_t written = 0;
+	if (numSpans)
+	{
+		iovec iov[2];
+		for (int i = 0; i < numSpans; ++i)
+			iov[i] = { ptr[i], len[i] };
+		const ssize_t n = ::writev(mFileDesc, iov, numSpans);
+		if (n < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			handleError(errno);
+			return;
+		}
+		written = n > 0 ? size_t(n) : 0;
+	}
+
+	bool drained;
+	{
+		std::lock_guard lock(mTxMutex);
+		mTx.discard(written);
+		drained = mTx.empty();
+	}
+
+	// Wait for the driver to take more, instead of retrying
+	mService.setWriteInterest(this, !drained);
+	if (drained && written && mOnDrain)
+		mOnDrain();
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void AsyncSerialPort::handleError(int _error)
+{
+	{
+		std::lock_guard lock(mTxMutex);
+		mFailed = true;
+	}
+	if (mOnError)
+		mOnError(_error);
+	if (mRegistered)
+	{
+		mRegistered = false;
+		mService.remove(this);
+	}
+}
+
+#endif // __linux__
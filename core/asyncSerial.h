@@ -0,0 +1,151 @@
+// Asynchronous serial ports, serviced by a single I/O thread
+#pragma once
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------------------------------------------
+// Fixed capacity byte FIFO. Capacity is rounded up to a power of two.
+// Not thread safe by itself: AsyncSerialPort guards the one it shares between threads.
+class ByteRing
+{
+public:
+	explicit ByteRing(size_t _capacity);
+
+	size_t	capacity	() const { return mData.size(); }
+	size_t	size		() const { return mTail - mHead; }
+	size_t	space		() const { return capacity() - size(); }
+	bool	empty		() const { return mHead == mTail; }
+
+	uint8_t	peek		(size_t _i) const { return mData[(mHead + _i) & mMask]; } // _i-th oldest byte
+	size_t	peek		(void* _dst, size_t _nBytes) const; // Copies up to _nBytes without consuming them
+	size_t	read		(void* _dst, size_t _nBytes); // Returns the amount of bytes read
+	void	discard		(size_t _nBytes);
+	bool	write		(const void* _src, size_t _nBytes); // All or nothing. False once closed or failed.
+	void	clear		() { mHead = mTail = 0; }
+
+	// Contiguous spans of the stored bytes (readable) and of the free space (writable).
+	// Each returns the number of spans, 0 to 2, for readv/writev. Commit with discard/produce.
+	int		readable	(uint8_t* _ptr[2], size_t _len[2]) const;
+	int		writable	(uint8_t* _ptr[2], size_t _len[2]);
+	void	produce		(size_t _nBytes) { mTail += _nBytes; }
+
+private:
+	std::vector<uint8_t>	mData;
+	size_t					mMask;
+	size_t					mHead = 0; // Free running counters
+	size_t					mTail = 0;
+};
+
+class AsyncSerialPort;
+
+//------------------------------------------------------------------------------------------------------------------
+// One epoll loop, on its own thread, for any number of ports.
+// Reads are level triggered: one readv per wakeup drains as much as the receive ring can take.
+// Writes go straight from the transmit rings, and EPOLLOUT is only armed while the driver is full.
+// Callbacks run on the I/O thread.
+class SerialIOService
+{
+public:
+	SerialIOService();
+	~SerialIOService(); // Ports must be closed first
+
+	bool isRunning() const { return mEpollFd >= 0 && !mStopped; }
+	bool isIOThread() const { return std::this_thread::get_id() == mThread.get_id(); }
+
+private:
+	friend class AsyncSerialPort;
+
+	void	add				(AsyncSerialPort*);
+	void	remove			(AsyncSerialPort*); // Returns once no callback of the port runs, or will
+	void	requestFlush	(AsyncSerialPort*);
+	void	setWriteInterest(AsyncSerialPort*, bool);
+	void	wake			();
+	void	run				();
+	void	processRequests	();
+
+	int						mEpollFd = -1;
+	int						mWakeFd = -1; // eventfd
+	std::thread				mThread;
+	std::atomic<bool>		mMustClose = false;
+	std::atomic<bool>		mStopped = false; // The I/O thread exited. Set under mRequestMutex.
+
+	std::mutex						mRequestMutex;
+	std::condition_variable			mRemoved;
+	std::vector<AsyncSerialPort*>	mPendingFlush;
+	std::vector<AsyncSerialPort*>	mPendingRemoval;
+	uint64_t						mRemovalsDone = 0;
+	uint64_t						mRemovalsRequested = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------
+// Non blocking serial port, serviced by a SerialIOService.
+// write() may be called from any thread. It only queues the data, and fails when the transmit queue
+// can't take it all, so producers see backpressure instead of blocking.
+class AsyncSerialPort
+{
+public:
+	// Called on the I/O thread with all the received bytes that haven't been consumed yet.
+	// Consume whatever is useful, and leave incomplete data for the next call.
+	using DataDelegate = std::function<void(ByteRing& _received)>;
+	// Called on the I/O thread when the transmit queue empties
+	using DrainDelegate = std::function<void()>;
+	// Called on the I/O thread with errno, when the port fails. The port stops being serviced.
+	using ErrorDelegate = std::function<void(int _error)>;
+
+	AsyncSerialPort	(SerialIOService& _service, const char* _port, unsigned _baudRate, size_t _rxCapacity = 4096, size_t _txCapacity = 4096);
+	~AsyncSerialPort();
+
+	AsyncSerialPort(const AsyncSerialPort&) = delete;
+	AsyncSerialPort& operator=(const AsyncSerialPort&) = delete;
+
+	// Delegates must be set before start()
+	void	onData		(const DataDelegate& _cb) { mOnData = _cb; }
+	void	onDrain		(const DrainDelegate& _cb) { mOnDrain = _cb; }
+	void	onError		(const ErrorDelegate& _cb) { mOnError = _cb; }
+
+	bool	isOpen		() const { return mFileDesc >= 0; }
+	void	start		(); // Starts servicing the port
+	void	close		(); // Cancels pending I/O. Safe to call from callbacks.
+
+	bool	write		(const void* _src, size_t _nBytes); // All or nothing
+	size_t	writeSpace	() const;
+	size_t	overflows	() const { return mOverflows; } // Receive buffer overruns
+
+	int		fileDesc	() const { return mFileDesc; }
+	unsigned	baudRate	() const { return mBaudRate; } // As achieved by the driver
+
+private:
+	friend class SerialIOService;
+
+	void	handleReadable	();
+	void	handleWritable	(); // Flushes the transmit queue
+	void	handleError		(int _error);
+
+	SerialIOService&	mService;
+	std::atomic<int>	mFileDesc = -1; // Reset under mTxMutex
+	unsigned			mBaudRate = 0;
+	std::atomic<bool>	mRegistered = false;
+	bool				mWriteArmed = false; // EPOLLOUT, I/O thread only
+
+	ByteRing			mRx; // I/O thread only
+	ByteRing			mTx;
+	mutable std::mutex	mTxMutex;
+	bool				mFlushQueued = false; // Guarded by mTxMutex
+	bool				mFailed = false; // Guarded by mTxMutex. Nothing will send queued data anymore.
+	std::atomic<size_t>	mOverflows = 0;
+
+	DataDelegate		mOnData;
+	DrainDelegate		mOnDrain;
+	ErrorDelegate		mOnError;
+};
+
+#endif // __linux__
@@ -0,0 +1,268 @@
+// Round trip benchmark for the asynchronous serial ports in core/asyncSerial.h.
+// Sends framed packets through an AsyncSerialPort and waits for them to come back, keeping up to
+// --window of them in flight, then prints throughput, latency and I/O counters as JSON.
+// Without --port, the other end is a pseudo terminal that echoes everything. With --port, the
+// device must echo too, e.g. a USB adapter with TX wired to RX.
+
+#include "asyncSerial.h"
+#include "cmdLineParser.h"
+
+#include <RobotHAL/PacketFramer.h>
+
+extern "C" {
+	#include <pty.h>
+	#include <termios.h>
+	#include <unistd.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+	struct PacketHeader
+	{
+		uint32_t seq;
+		int64_t sentNs;
+	};
+
+	int64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	// Master side of a pseudo terminal, writing back everything it reads
+	class Echo
+	{
+	public:
+		bool open(std::string& slaveName)
+		{
+			struct termios raw;
+			cfmakeraw(&raw);
+			char name[64];
+			if (openpty(&m_master, &m_slave, name, &raw, nullptr) != 0)
+				return false;
+			slaveName = name;
+			return true;
+		}
+
+		// Once the port has opened the slave side by name. Reads on the master fail while no one
+		// has it open.
+		void start()
+		{
+			::close(m_slave);
+			m_slave = -1;
+			m_thread = std::thread([this]() { run(); });
+		}
+
+		~Echo()
+		{
+			if (m_slave >= 0)
+				::close(m_slave);
+			if (m_thread.joinable())
+				m_thread.join();
+			if (m_master >= 0)
+				::close(m_master);
+		}
+
+	private:
+		// Ends when the port closes the slave side, and reads fail with EIO
+		void run()
+		{
+			uint8_t buffer[4096];
+			for (;;)
+			{
+				const ssize_t n = ::read(m_master, buffer, sizeof(buffer));
+				if (n <= 0)
+					return;
+				for (ssize_t sent = 0; sent < n;)
+				{
+					const ssize_t w = ::write(m_master, buffer + sent, n - sent);
+					if (w <= 0)
+						return;
+					sent += w;
+				}
+			}
+		}
+
+		int m_master = -1;
+		int m_slave = -1;
+		std::thread m_thread;
+	};
+}
+
+//----------------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	std::string portName;
+	int baudRate = 1000000;
+	int numPackets = 20000;
+	int packetSize = 32; // Payload bytes
+	int window = 8; // Packets in flight
+	double timeout = 10; // Seconds without any packet coming back
+	std::string outFile;
+
+	CmdLineParser parser;
+	parser.addOption("port", &portName);
+	parser.addOption("baud", &baudRate);
+	parser.addOption("packets", &numPackets);
+	parser.addOption("size", &packetSize);
+	parser.addOption("window", &window);
+	parser.addOption("timeout", &timeout);
+	parser.addOption("out", &outFile);
+	parser.parse(argc, const_cast<const char**>(argv));
+
+	if (numPackets < 1 || window < 1 || baudRate < 1 || timeout <= 0)
+	{
+		fprintf(stderr, "Error: packets, window, baud and timeout must be positive\n");
+		return -1;
+	}
+	if (packetSize < int(sizeof(PacketHeader)) || packetSize > PacketFramer::MAX_PAYLOAD)
+	{
+		fprintf(stderr, "Error: size must be between %d and %d\n", int(sizeof(PacketHeader)), PacketFramer::MAX_PAYLOAD);
+		return -1;
+	}
+
+	FILE* out = outFile.empty() ? stdout : fopen(outFile.c_str(), "w");
+	if (!out)
+	{
+		fprintf(stderr, "Error: Unable to open %s\n", outFile.c_str());
+		return -1;
+	}
+
+	Echo echo;
+	const bool loopback = portName.empty();
+	if (loopback && !echo.open(portName))
+	{
+		fprintf(stderr, "Error: Unable to open a pseudo terminal\n");
+		return -1;
+	}
+
+	// Written on the I/O thread. Read once the port is closed, or under the mutex.
+	std::mutex mutex;
+	std::condition_variable progress;
+	std::vector<double> latencyUs(numPackets, -1);
+	int numReceived = 0;
+	int numCallbacks = 0;
+	int numUnexpected = 0;
+	int portError = 0;
+	PacketFramer framer(packetSize);
+
+	SerialIOService service;
+	AsyncSerialPort port(service, portName.c_str(), unsigned(baudRate));
+	if (!port.isOpen())
+		return -1;
+	if (loopback)
+		echo.start();
+
+	port.onData([&](ByteRing& received) {
+		const int64_t now = nowNs();
+		int numExtracted = 0;
+		while (!received.empty())
+		{
+			int space;
+			uint8_t* dst = framer.writeSpan(space);
+			framer.produce(int(received.read(dst, size_t(space))));
+			numExtracted += framer.extract([&](const uint8_t* payload, int size) {
+				PacketHeader header;
+				memcpy(&header, payload, sizeof(header));
+				std::lock_guard lock(mutex);
+				if (size != packetSize || header.seq >= latencyUs.size() || latencyUs[header.seq] >= 0)
+				{
+					++numUnexpected;
+					return;
+				}
+				latencyUs[header.seq] = (now - header.sentNs) * 1e-3;
+				++numReceived;
+			});
+		}
+		std::lock_guard lock(mutex);
+		++numCallbacks;
+		if (numExtracted)
+			progress.notify_one();
+	});
+	port.onError([&](int error) {
+		std::lock_guard lock(mutex);
+		portError = error;
+		progress.notify_one();
+	});
+	port.start();
+
+	std::vector<uint8_t> payload(packetSize);
+	std::vector<uint8_t> packet(packetSize + 3);
+	for (int i = 0; i < packetSize; ++i)
+		payload[i] = uint8_t(i * 37);
+
+	int numSent = 0;
+	int numRejected = 0; // Writes refused by a full transmit queue
+	bool timedOut = false;
+	const auto start = Clock::now();
+	{
+		std::unique_lock lock(mutex);
+		while (numReceived < numPackets && !portError)
+		{
+			while (numSent < numPackets && numSent - numReceived < window)
+			{
+				const PacketHeader header = { uint32_t(numSent), nowNs() };
+				memcpy(payload.data(), &header, sizeof(header));
+				const int size = PacketFramer::encode(payload.data(), packetSize, packet.data());
+				if (!port.write(packet.data(), size_t(size)))
+				{
+					++numRejected;
+					break;
+				}
+				++numSent;
+			}
+			const int before = numReceived;
+			progress.wait_for(lock, std::chrono::duration<double>(timeout), [&]() { return numReceived != before || portError; });
+			if (numReceived == before && !portError)
+			{
+				timedOut = true;
+				break;
+			}
+		}
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	port.close();
+
+	std::vector<double> sorted;
+	sorted.reserve(numReceived);
+	for (double t : latencyUs)
+		if (t >= 0)
+			sorted.push_back(t);
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](double p) {
+		return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+	};
+
+	const int packetBytes = packetSize + 3;
+	fprintf(out, "{\n");
+	fprintf(out, "  \"port\": \"%s\",\n  \"loopback\": %s,\n  \"baud\": %d,\n  \"achievedBaud\": %u,\n",
+		loopback ? "pty" : portName.c_str(), loopback ? "true" : "false", baudRate, port.baudRate());
+	fprintf(out, "  \"packets\": %d,\n  \"size\": %d,\n  \"window\": %d,\n", numPackets, packetSize, window);
+	fprintf(out, "  \"sent\": %d,\n  \"received\": %d,\n  \"seconds\": %.6f,\n", numSent, numReceived, seconds);
+	fprintf(out, "  \"packetsPerSecond\": %.1f,\n  \"bytesPerSecond\": %.1f,\n",
+		numReceived / seconds, double(numReceived) * packetBytes / seconds);
+	fprintf(out, "  \"latencyUs\": { \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f },\n",
+		percentile(0.5), percentile(0.99), sorted.empty() ? 0.0 : sorted.back());
+	fprintf(out, "  \"dataCallbacks\": %d,\n  \"packetsPerCallback\": %.2f,\n",
+		numCallbacks, numCallbacks ? double(numReceived) / numCallbacks : 0.0);
+	fprintf(out, "  \"rejectedWrites\": %d,\n  \"overflows\": %zu,\n  \"checksumErrors\": %d,\n  \"droppedBytes\": %d,\n  \"unexpected\": %d,\n",
+		numRejected, port.overflows(), framer.checksumErrors(), framer.droppedBytes(), numUnexpected);
+	fprintf(out, "  \"timedOut\": %s,\n  \"error\": \"%s\"\n}\n", timedOut ? "true" : "false", portError ? strerror(portError) : "");
+
+	if (out != stdout)
+		fclose(out);
+	return numReceived == numPackets ? 0 : 1;
+}
@@ -20,29 +20,10 @@ SerialLinux::SerialLinux(const char* _port, unsigned _baudRate)
 
 	openPortFile(_port);
 
-	// Gett addess info
-	mPortConfig = new termios;
-	memset (mPortConfig, 0, sizeof(struct termios)); // Clear memory
-
-	if ( tcgetattr ( mFileDesc, mPortConfig) != 0 ) // Get port address
+	if (!configureSerialPort(mFileDesc, _baudRate, true, &mBaudRate))
 	{
-		std::cout << "Error: Unable to open serial port " << _port << "\n";
+		std::cout << "Error: Unable to configure serial port " << _port << "\n";
 	}
-	setBaudRate(mPortConfig, _baudRate, _port);
-
-	mPortConfig->c_cflag &= ~PARENB;    // Set no parity, no stop bits. Byte size = 8
-	mPortConfig->c_cflag &= ~CSTOPB;
-	mPortConfig->c_cflag &= ~CSIZE;
-	mPortConfig->c_cflag |= CS8; // 8-bit frame size
-	mPortConfig->c_cflag |= CREAD; // Enable reading
-	mPortConfig->c_cc[VMIN] = 1; // Always read at least one character
-	mPortConfig->c_cc[VTIME] = 0; // Disable time-out?
-
-	cfmakeraw(mPortConfig); // Apply configuration;
-	tcflush( mFileDesc, TCIFLUSH );	// Flush port to set atributes
-
-	if ( tcsetattr ( mFileDesc, TCSANOW, mPortConfig ) != 0) // Set attributes
-	std::cout << "Error: Unable to set serial port attributes\n";
 
 	clearInputBuffer();
 }
@@ -50,17 +31,18 @@ SerialLinux::SerialLinux(const char* _port, unsigned _baudRate)
 //------------------------------------------------------------------------------------------------------------------
 void SerialLinux::setBlocking(bool _blocking)
 {
-	memset (mPortConfig, 0, sizeof(struct termios));
-	if (tcgetattr (mFileDesc, mPortConfig) != 0)
+	struct termios config;
+	memset (&config, 0, sizeof(struct termios));
+	if (tcgetattr (mFileDesc, &config) != 0)
 	{
 		std::cout << "error " << errno << " getting term settings set_blocking\n";
 		return;
 	}
 
-	mPortConfig->c_cc[VMIN]  = _blocking ? 1 : 0;
-	mPortConfig->c_cc[VTIME] = _blocking ? 5 : 0; // 0.5 seconds read timeout
+	config.c_cc[VMIN]  = _blocking ? 1 : 0;
+	config.c_cc[VTIME] = _blocking ? 5 : 0; // 0.5 seconds read timeout
 
-	if (tcsetattr (mFileDesc, TCSANOW, mPortConfig) != 0)
+	if (tcsetattr (mFileDesc, TCSANOW, &config) != 0)
 	{
 		std::cout << "error setting term " << (_blocking ? "" : "not-") << "sblocking\n";
 	}
@@ -118,7 +100,7 @@ unsigned SerialLinux::read(void * _dst, unsigned _nBytes)
 uint8_t SerialLinux::read()
 {
 	uint8_t data;
-	unsigned nBytesRead = ::read(mFileDesc, &data , 1);
+	int nBytesRead = ::read(mFileDesc, &data , 1);
 	if(nBytesRead < 0)
 	{
 		std::cout << "Error: reading from serial port failed\n";
@@ -142,37 +124,42 @@ void SerialLinux::openPortFile(const char* _port)
 }
 
 //------------------------------------------------------------------------------------------------------------------
-void SerialLinux::setBaudRate(struct termios* _serialPortInfo, unsigned _baudRate, const char* _port)
+bool configureSerialPort(int _fileDesc, unsigned _baudRate, bool _blocking, unsigned* _actualBaudRate)
 {
-	// Actually select address
-	speed_t commBaudRate;
-	switch (_baudRate) {
-		case 4800:
-			commBaudRate = (speed_t)B4800;
-			break;
-		case 9600:
-			commBaudRate = (speed_t)B9600;
-			break;
-		case 19200:
-			commBaudRate = (speed_t)B19200;
-			break;
-		case 38400:
-			commBaudRate = (speed_t)B38400;
-			break;
-		case 57600:
-			commBaudRate = (speed_t)B57600;
-			break;
-		case 115200:
-			commBaudRate = (speed_t)B115200;
-			break;
-		default:
-			commBaudRate = (speed_t)B115200;
-			assert(false); // Unsupported baudrate
-			return;
+	struct termios config;
+	memset(&config, 0, sizeof(config));
+	if (tcgetattr(_fileDesc, &config) != 0) // Get port address
+		return false;
+
+	cfmakeraw(&config);
+	config.c_cflag &= ~PARENB;    // Set no parity, no stop bits. Byte size = 8
+	config.c_cflag &= ~CSTOPB;
+	config.c_cflag &= ~CSIZE;
+	config.c_cflag |= CS8; // 8-bit frame size
+	// Enable reading. Ignore modem lines: USB adapters and robot boards don't drive carrier detect, and
+	// without CLOCAL a dropped carrier hangs up the port and non blocking reads start returning 0.
+	config.c_cflag |= CREAD | CLOCAL;
+	config.c_cc[VMIN] = _blocking ? 1 : 0; // Blocking reads wait for at least one character
+	config.c_cc[VTIME] = 0; // No inter-byte time-out
+
+	tcflush(_fileDesc, TCIFLUSH);	// Flush port to set atributes
+	if (tcsetattr(_fileDesc, TCSANOW, &config) != 0)
+		return false;
+
+	// The speed goes through termios2, which the termios above can't express
+	unsigned actualBaudRate = 0;
+	if (!setSerialBaudRate(_fileDesc, _baudRate, &actualBaudRate))
+		return false;
+	// UARTs tolerate a few percent of mismatch between both ends
+	if (actualBaudRate < _baudRate * 0.98 || actualBaudRate > _baudRate * 1.02)
+	{
+		std::cout << "Warning: Requested " << _baudRate << " bauds, got " << actualBaudRate << "\n";
 	}
+	if (_actualBaudRate)
+		*_actualBaudRate = actualBaudRate;
 
-	cfsetospeed (_serialPortInfo, commBaudRate);
-	cfsetispeed (_serialPortInfo, commBaudRate);
+	setSerialLowLatency(_fileDesc);
+	return true;
 }
 
 #endif // __linux__
@@ -204,7 +191,7 @@ unsigned SerialWin32::write(const void* _src, unsigned _nBytes) {
 //------------------------------------------------------------------------------------------------------------------
 unsigned SerialWin32::read(void * _dstBuffer, unsigned _nBytes)
 {
-	DWORD readBytes;
+	DWORD readBytes = 0;
 	::ReadFile(mPortHandle, _dstBuffer, _nBytes, &readBytes, NULL);
 	return readBytes;
 
@@ -235,6 +222,21 @@ void SerialWin32::openPort(const char* _port) {
 		FILE_ATTRIBUTE_NORMAL,
 		0); // No templates
 	assert(INVALID_HANDLE_VALUE != mPortHandle);
+
+	// Reads give up after 100ms without data, so reading threads can check for termination.
+	setReadTimeout(100);
+}
+
+//------------------------------------------------------------------------------------------------------------------
+void SerialWin32::setReadTimeout(unsigned _ms) {
+	// Like on linux, reads wait for the first byte, then return whatever is available.
+	// The wait only applies with a non zero constant, otherwise reads return immediately.
+	assert(_ms > 0 && _ms < MAXDWORD);
+	COMMTIMEOUTS timeouts = {0};
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = _ms;
+	::SetCommTimeouts(mPortHandle, &timeouts);
 }
 
 //------------------------------------------------------------------------------------------------------------------
@@ -5,9 +5,6 @@
 #if defined(__linux__)
 
 #include <cstdint>
-extern "C" {
-#include <termios.h>
-}
 
 class SerialLinux {
 public:
@@ -17,20 +14,33 @@ public:
 	unsigned	read		(void * _dst, unsigned _nBytes); // Returns the amount of bytes read
 	uint8_t		read		(); // Reads one byte
 
+	unsigned	baudRate	() const { return mBaudRate; } // As achieved by the driver, 0 if not configured
+
 protected:
 	SerialLinux						(const char* _port, unsigned _baudRate);
 	void		setBlocking			(bool);
 	void		clearInputBuffer	();
 	void		openPortFile		(const char* _port);
-	void		setBaudRate			(struct termios* _serialPortInfo, unsigned _baudRate, const char* _port);
 	
 private:
 	int				mFileDesc;
-	struct termios*	mPortConfig;
+	unsigned		mBaudRate = 0;
 };
 
 typedef SerialLinux SerialBase;
 
+// Raw 8N1 mode at _baudRate, for an open port. Blocking reads wait for at least one byte.
+// Also requests low latency from the driver. Shared by SerialLinux and AsyncSerialPort.
+bool configureSerialPort(int _fileDesc, unsigned _baudRate, bool _blocking, unsigned* _actualBaudRate = nullptr);
+
+// Any baud rate the driver can produce, not only the standard ones (termios2, serialBaudLinux.cpp).
+// _actualBaudRate receives the rate the driver reports after rounding to its divisors.
+bool setSerialBaudRate(int _fileDesc, unsigned _baudRate, unsigned* _actualBaudRate = nullptr);
+
+// Best effort: sets ASYNC_LOW_LATENCY, and the latency timer of FTDI USB adapters, in ms.
+// Returns false when neither could be set, e.g. on pseudo terminals.
+bool setSerialLowLatency(int _fileDesc, unsigned _latencyTimerMs = 1);
+
 #endif // __linux__
 
 #ifdef _WIN32
@@ -43,9 +53,11 @@ class SerialWin32 {
 		unsigned	write	(const void* _src, unsigned _nBytes);
 		bool		write	(uint8_t);
 
-		unsigned	read	(void * _dst, unsigned _nBytes); 
+		unsigned	read	(void * _dst, unsigned _nBytes); // Returns the bytes available, up to _nBytes. 0 on timeout
 		uint8_t		read	(); 
 
+		void		setReadTimeout	(unsigned _ms); // How long reads wait for the first byte. 100ms by default.
+
 
 	protected:
 		SerialWin32			(const char* _port, unsigned _baudRate);
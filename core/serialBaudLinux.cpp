@@ -0,0 +1,84 @@
+// Baud rate and latency settings for Linux serial ports.
+// Kept apart from serial.cpp because termios2 lives in <asm/termbits.h>, which can't be included
+// together with the glibc <termios.h>. serial.h must not include it either.
+#if defined(__linux__)
+
+extern "C" {
+	#include <asm/termbits.h>
+	#include <linux/serial.h>
+	#include <sys/ioctl.h>
+	#include <unistd.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "serial.h"
+
+//------------------------------------------------------------------------------------------------------------------
+bool setSerialBaudRate(int _fileDesc, unsigned _baudRate, unsigned* _actualBaudRate)
+{
+	struct termios2 config;
+	if (ioctl(_fileDesc, TCGETS2, &config) != 0)
+		return false;
+
+	// BOTHER takes the rate in bauds instead of one of the Bxxx constants, so any rate the UART
+	// can divide down to works, like 1 Mbaud for dynamixel buses.
+	config.c_cflag &= ~CBAUD;
+	config.c_cflag |= BOTHER;
+	config.c_ispeed = _baudRate;
+	config.c_ospeed = _baudRate;
+	if (ioctl(_fileDesc, TCSETS2, &config) != 0)
+		return false;
+
+	// Drivers write back the rate their divisors actually produce
+	if (_actualBaudRate)
+	{
+		if (ioctl(_fileDesc, TCGETS2, &config) != 0)
+			return false;
+		*_actualBaudRate = config.c_ospeed;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+// Name of the tty device behind an open file, e.g. "ttyUSB0"
+static std::string ttyName(int _fileDesc)
+{
+	char link[64];
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", _fileDesc);
+	char path[256];
+	ssize_t len = readlink(link, path, sizeof(path) - 1);
+	if (len <= 0)
+		return std::string();
+	path[len] = '\0';
+	const char* name = strrchr(path, '/');
+	return name ? name + 1 : path;
+}
+
+//------------------------------------------------------------------------------------------------------------------
+bool setSerialLowLatency(int _fileDesc, unsigned _latencyTimerMs)
+{
+	bool lowLatency = false;
+	struct serial_struct serial;
+	if (ioctl(_fileDesc, TIOCGSERIAL, &serial) == 0)
+	{
+		serial.flags |= ASYNC_LOW_LATENCY;
+		lowLatency = ioctl(_fileDesc, TIOCSSERIAL, &serial) == 0;
+	}
+
+	// FTDI adapters hold received bytes for up to 16ms before sending a USB packet, unless their
+	// buffer fills. That timer is only exposed through sysfs, and may need write permissions.
+	const std::string name = ttyName(_fileDesc);
+	if (name.empty())
+		return lowLatency;
+	const std::string timerPath = "/sys/bus/usb-serial/devices/" + name + "/latency_timer";
+	FILE* timer = fopen(timerPath.c_str(), "w");
+	if (!timer)
+		return lowLatency;
+	const bool timerSet = fprintf(timer, "%u", _latencyTimerMs) > 0;
+	return (fclose(timer) == 0 && timerSet) || lowLatency;
+}
+
+#endif // __linux__
@@ -163,6 +163,11 @@ namespace math
 		const Vector& max() const { return mMax; }
 		Vector size() const { return mMax - mMin; }
 
+		float area() const {
+			auto h = mMax - mMin;
+			return 2.f*(h.x()*h.y()+h.x()*h.z()+h.y()*h.z());
+		}
+
 		/// find intersection between this box and a ray, in the ray's parametric interval [_tmin, _tmax]
 		/// Also, store the minimun intersection distance into _tout
 		bool intersect(const Ray::ImplicitSimd& _r, float4 _tmax, float& _tCollide) const {
@@ -0,0 +1,513 @@
+#pragma once
+// Bounding volume hierarchy over static boxes.
+// Built with a binned surface area heuristic, then collapsed into a 4-wide tree
+// whose nodes store their children's bounds in SoA form, so one node visit tests all 4 children at once.
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "aabb.h"
+#include "ray.h"
+#include "vectorFloat.h"
+
+namespace math
+{
+	class BVH
+	{
+	public:
+		BVH() = default;
+
+		void build(const AABB* boxes, size_t count);
+		void clear();
+
+		bool empty() const { return m_nodes.empty() && m_rootLeafCount == 0; }
+		size_t size() const { return m_primIndices.size(); }
+
+		// Calls onOverlap(primitiveIndex) for every primitive whose box contains p
+		template<class F>
+		void queryPoint(const Vec3f& p, F&& onOverlap) const;
+
+		// Calls onOverlap(primitiveIndex) for every primitive whose box overlaps the sphere
+		template<class F>
+		void querySphere(const Vec3f& center, float radius, F&& onOverlap) const;
+
+		// Closest hit among the primitive boxes in [0, tMax].
+		// Returns the index of the primitive hit, or -1 on miss.
+		int raycast(const Ray& ray, float tMax, float& tHit) const;
+
+		// Closest hit against arbitrary primitives.
+		// hitPrimitive(primitiveIndex, tMax) must return the distance to the primitive if hit before tMax, or a negative value otherwise.
+		template<class F>
+		int raycast(const Ray& ray, float tMax, float& tHit, F&& hitPrimitive) const;
+
+	private:
+		static constexpr int kMaxLeafSize = 4;
+		static constexpr int kNumBins = 16;
+		static constexpr int kLocalStackSize = 64; // Traversal stacks of deeper trees go on the heap
+		static constexpr float kTraversalCost = 1.f; // Relative to a primitive test
+
+		struct alignas(16) Node
+		{
+			// Child bounds, one lane per child
+			float4 minX, minY, minZ;
+			float4 maxX, maxY, maxZ;
+			// Inner nodes: child node index, and count == 0.
+			// Leaves: first primitive, and number of primitives.
+			int32_t child[4];
+			uint16_t count[4];
+			int32_t validMask; // One bit per used child slot
+		};
+
+		struct BuildNode
+		{
+			AABBSimd bounds;
+			int left = -1, right = -1; // Children in the binary tree
+			int first = 0, count = 0; // Primitive range, for leaves
+
+			bool isLeaf() const { return left < 0; }
+		};
+
+		int buildRecursive(std::vector<BuildNode>& tree, const std::vector<AABBSimd>& bounds, const std::vector<float4>& centroids, int first, int count);
+		int collapse(const std::vector<BuildNode>& tree, int binaryNode, int depth);
+
+		// Traversal shared by both raycasts. hitLeafPrimitive receives positions in leaf order.
+		template<class F>
+		int raycastLeaves(const Ray& ray, float tMax, float& tHit, F&& hitLeafPrimitive) const;
+
+		std::vector<Node> m_nodes;
+		std::vector<int> m_primIndices; // Original primitive indices in leaf order
+		std::vector<AABB> m_primBoxes; // Primitive bounds in leaf order
+		int m_rootLeafCount = 0; // Trees with a single leaf have no nodes
+		int m_stackSize = 0; // Deepest traversal stack, from the depth of the tree
+
+		// Build scratch, kept so trees rebuilt every frame don't allocate once warm
+		std::vector<AABBSimd> m_buildBounds;
+		std::vector<float4> m_buildCentroids;
+		std::vector<BuildNode> m_buildTree;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	inline void BVH::clear()
+	{
+		m_nodes.clear();
+		m_primIndices.clear();
+		m_primBoxes.clear();
+		m_rootLeafCount = 0;
+		m_stackSize = 0;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	inline void BVH::build(const AABB* boxes, size_t count)
+	{
+		clear();
+		if (!count)
+			return;
+
+		std::vector<AABBSimd>& bounds = m_buildBounds;
+		std::vector<float4>& centroids = m_buildCentroids;
+		bounds.resize(count);
+		centroids.resize(count);
+		m_primIndices.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			bounds[i] = AABBSimd(boxes[i].min(), boxes[i].max());
+			centroids[i] = (bounds[i].min() + bounds[i].max()) * float4(0.5f);
+			m_primIndices[i] = int(i);
+		}
+
+		std::vector<BuildNode>& tree = m_buildTree;
+		tree.clear();
+		tree.reserve(2 * count);
+		buildRecursive(tree, bounds, centroids, 0, int(count));
+
+		m_primBoxes.resize(count);
+		for (size_t i = 0; i < count; ++i)
+			m_primBoxes[i] = boxes[m_primIndices[i]];
+
+		if (tree[0].isLeaf())
+		{
+			m_rootLeafCount = tree[0].count;
+			return;
+		}
+		m_nodes.reserve(tree.size() / 2 + 1);
+		collapse(tree, 0, 1);
+	}
+
+	//---------------------------------------------------------------------------------------------
+	inline int BVH::buildRecursive(std::vector<BuildNode>& tree, const std::vector<AABBSimd>& bounds, const std::vector<float4>& centroids, int first, int count)
+	{
+		const int nodeIndex = int(tree.size());
+		tree.emplace_back();
+
+		AABBSimd nodeBounds, centroidBounds;
+		nodeBounds.clear();
+		centroidBounds.clear();
+		for (int i = first; i < first + count; ++i)
+		{
+			int prim = m_primIndices[i];
+			nodeBounds = AABBSimd(nodeBounds, bounds[prim]);
+			centroidBounds.add(centroids[prim]);
+		}
+		tree[nodeIndex].bounds = nodeBounds;
+		tree[nodeIndex].first = first;
+		tree[nodeIndex].count = count;
+
+		if (count <= 1)
+			return nodeIndex;
+
+		// Find the best split among binned candidates along all three axes
+		const float4 cMin = centroidBounds.min();
+		const float4 cExtent = centroidBounds.max() - cMin;
+		const float extent[3] = { cExtent.x(), cExtent.y(), cExtent.z() };
+		const float origin[3] = { cMin.x(), cMin.y(), cMin.z() };
+
+		float bestCost = std::numeric_limits<float>::infinity();
+		int bestAxis = -1;
+		int bestBin = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (extent[axis] <= 0.f)
+				continue;
+
+			AABBSimd binBounds[kNumBins];
+			int binCount[kNumBins] = {};
+			for (auto& b : binBounds)
+				b.clear();
+
+			const float scale = kNumBins * (1 - 1e-5f) / extent[axis];
+			for (int i = first; i < first + count; ++i)
+			{
+				int prim = m_primIndices[i];
+				const float4& c = centroids[prim];
+				float ci = axis == 0 ? c.x() : (axis == 1 ? c.y() : c.z());
+				int bin = int((ci - origin[axis]) * scale);
+				binCount[bin]++;
+				binBounds[bin] = AABBSimd(binBounds[bin], bounds[prim]);
+			}
+
+			// Sweep from the right to get the area of every right partition
+			float rightArea[kNumBins];
+			int rightCount[kNumBins];
+			AABBSimd accum;
+			accum.clear();
+			int accumCount = 0;
+			for (int i = kNumBins - 1; i > 0; --i)
+			{
+				accum = AABBSimd(accum, binBounds[i]);
+				accumCount += binCount[i];
+				rightArea[i] = accumCount ? accum.area() : 0.f;
+				rightCount[i] = accumCount;
+			}
+
+			// Then from the left, evaluating the split after every bin
+			accum.clear();
+			accumCount = 0;
+			for (int i = 0; i < kNumBins - 1; ++i)
+			{
+				accum = AABBSimd(accum, binBounds[i]);
+				accumCount += binCount[i];
+				if (!accumCount || !rightCount[i + 1])
+					continue;
+				float cost = accumCount * accum.area() + rightCount[i + 1] * rightArea[i + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+
+		int mid;
+		if (bestAxis < 0)
+		{
+			// All centroids coincide. Split in half to bound the depth.
+			if (count <= kMaxLeafSize)
+				return nodeIndex;
+			mid = first + count / 2;
+		}
+		else
+		{
+			// Compare against the cost of not splitting at all
+			const float nodeArea = nodeBounds.area();
+			const float splitCost = kTraversalCost + (nodeArea > 0 ? bestCost / nodeArea : 0.f);
+			if (count <= kMaxLeafSize && splitCost >= float(count))
+				return nodeIndex;
+
+			const float scale = kNumBins * (1 - 1e-5f) / extent[bestAxis];
+			auto midIter = std::partition(m_primIndices.begin() + first, m_primIndices.begin() + first + count, [&](int prim) {
+				const float4& c = centroids[prim];
+				float ci = bestAxis == 0 ? c.x() : (bestAxis == 1 ? c.y() : c.z());
+				return int((ci - origin[bestAxis]) * scale) <= bestBin;
+			});
+			mid = int(midIter - m_primIndices.begin());
+		}
+
+		int left = buildRecursive(tree, bounds, centroids, first, mid - first);
+		int right = buildRecursive(tree, bounds, centroids, mid, first + count - mid);
+		tree[nodeIndex].left = left;
+		tree[nodeIndex].right = right;
+		return nodeIndex;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	inline int BVH::collapse(const std::vector<BuildNode>& tree, int binaryNode, int depth)
+	{
+		assert(!tree[binaryNode].isLeaf());
+
+		// Depth first traversal leaves at most 3 siblings pending per level, plus the node being visited
+		m_stackSize = std::max(m_stackSize, 3 * depth + 1);
+
+		// Pull up grandchildren until we fill all four slots, opening the largest nodes first
+		int slots[4] = { tree[binaryNode].left, tree[binaryNode].right, -1, -1 };
+		int numSlots = 2;
+		while (numSlots < 4)
+		{
+			int best = -1;
+			float bestArea = -1.f;
+			for (int i = 0; i < numSlots; ++i)
+			{
+				const BuildNode& n = tree[slots[i]];
+				if (!n.isLeaf() && n.bounds.area() > bestArea)
+				{
+					bestArea = n.bounds.area();
+					best = i;
+				}
+			}
+			if (best < 0)
+				break;
+			int opened = slots[best];
+			slots[best] = tree[opened].left;
+			slots[numSlots++] = tree[opened].right;
+		}
+
+		const int nodeIndex = int(m_nodes.size());
+		m_nodes.emplace_back();
+
+		float lo[3][4], hi[3][4];
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				lo[a][i] = std::numeric_limits<float>::infinity();
+				hi[a][i] = -std::numeric_limits<float>::infinity();
+			}
+		}
+
+		int32_t child[4] = { -1, -1, -1, -1 };
+		uint16_t count[4] = {};
+		for (int i = 0; i < numSlots; ++i)
+		{
+			const BuildNode& n = tree[slots[i]];
+			const float4 bMin = n.bounds.min();
+			const float4 bMax = n.bounds.max();
+			lo[0][i] = bMin.x(); lo[1][i] = bMin.y(); lo[2][i] = bMin.z();
+			hi[0][i] = bMax.x(); hi[1][i] = bMax.y(); hi[2][i] = bMax.z();
+			if (n.isLeaf())
+			{
+				child[i] = n.first;
+				count[i] = uint16_t(n.count);
+			}
+			else
+			{
+				child[i] = collapse(tree, slots[i], depth + 1); // Careful, this invalidates references into m_nodes
+			}
+		}
+
+		Node& node = m_nodes[nodeIndex];
+		node.minX = float4(lo[0][0], lo[0][1], lo[0][2], lo[0][3]);
+		node.minY = float4(lo[1][0], lo[1][1], lo[1][2], lo[1][3]);
+		node.minZ = float4(lo[2][0], lo[2][1], lo[2][2], lo[2][3]);
+		node.maxX = float4(hi[0][0], hi[0][1], hi[0][2], hi[0][3]);
+		node.maxY = float4(hi[1][0], hi[1][1], hi[1][2], hi[1][3]);
+		node.maxZ = float4(hi[2][0], hi[2][1], hi[2][2], hi[2][3]);
+		for (int i = 0; i < 4; ++i)
+		{
+			node.child[i] = child[i];
+			node.count[i] = count[i];
+		}
+		node.validMask = (1 << numSlots) - 1;
+		return nodeIndex;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	template<class F>
+	void BVH::queryPoint(const Vec3f& p, F&& onOverlap) const
+	{
+		querySphere(p, 0.f, std::forward<F>(onOverlap));
+	}
+
+	//---------------------------------------------------------------------------------------------
+	template<class F>
+	void BVH::querySphere(const Vec3f& center, float radius, F&& onOverlap) const
+	{
+		auto visitLeaf = [&](int first, int count) {
+			for (int i = first; i < first + count; ++i)
+			{
+				const AABB& b = m_primBoxes[i];
+				Vec3f closest = math::max(b.min(), math::min(center, b.max()));
+				if ((closest - center).sqNorm() <= radius * radius)
+					onOverlap(m_primIndices[i]);
+			}
+		};
+
+		if (m_nodes.empty())
+		{
+			visitLeaf(0, m_rootLeafCount);
+			return;
+		}
+
+		const float4 cx(center.x()), cy(center.y()), cz(center.z());
+		const float4 r2(radius * radius);
+		const float4 zero(0.f);
+
+		int localStack[kLocalStackSize];
+		std::vector<int> heapStack;
+		int* stack = localStack;
+		if (m_stackSize > kLocalStackSize)
+		{
+			heapStack.resize(m_stackSize);
+			stack = heapStack.data();
+		}
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize)
+		{
+			const Node& node = m_nodes[stack[--stackSize]];
+
+			// Squared distance from the center to every child box
+			float4 dx = math::max(math::max(node.minX - cx, cx - node.maxX), zero);
+			float4 dy = math::max(math::max(node.minY - cy, cy - node.maxY), zero);
+			float4 dz = math::max(math::max(node.minZ - cz, cz - node.maxZ), zero);
+			float4 d2 = dx * dx + dy * dy + dz * dz;
+			int hits = (d2 <= r2).mask() & node.validMask;
+
+			while (hits)
+			{
+				int i = std::countr_zero(unsigned(hits));
+				hits &= hits - 1;
+				if (node.count[i])
+					visitLeaf(node.child[i], node.count[i]);
+				else
+				{
+					assert(stackSize < m_stackSize);
+					stack[stackSize++] = node.child[i];
+				}
+			}
+		}
+	}
+
+	//---------------------------------------------------------------------------------------------
+	inline int BVH::raycast(const Ray& ray, float tMax, float& tHit) const
+	{
+		const Ray::Implicit r = ray.implicit();
+		return raycastLeaves(ray, tMax, tHit, [&](int i, float tMax) {
+			float t;
+			return m_primBoxes[i].intersect(r, 0.f, tMax, t) ? t : -1.f;
+		});
+	}
+
+	//---------------------------------------------------------------------------------------------
+	template<class F>
+	int BVH::raycast(const Ray& ray, float tMax, float& tHit, F&& hitPrimitive) const
+	{
+		return raycastLeaves(ray, tMax, tHit, [&](int i, float tMax) {
+			return hitPrimitive(m_primIndices[i], tMax);
+		});
+	}
+
+	//---------------------------------------------------------------------------------------------
+	template<class F>
+	int BVH::raycastLeaves(const Ray& ray, float tMax, float& tHit, F&& hitLeafPrimitive) const
+	{
+		int hitIndex = -1;
+		auto visitLeaf = [&](int first, int count) {
+			for (int i = first; i < first + count; ++i)
+			{
+				float t = hitLeafPrimitive(i, tMax);
+				if (t >= 0 && t <= tMax)
+				{
+					tMax = t;
+					hitIndex = m_primIndices[i];
+				}
+			}
+		};
+
+		if (m_nodes.empty())
+		{
+			visitLeaf(0, m_rootLeafCount);
+			tHit = tMax;
+			return hitIndex;
+		}
+
+		const Ray::Implicit r = ray.implicit();
+		const float4 ox(r.o.x()), oy(r.o.y()), oz(r.o.z());
+		const float4 nx(r.n.x()), ny(r.n.y()), nz(r.n.z());
+
+		struct Entry { int node; float tEnter; };
+		Entry localStack[kLocalStackSize];
+		std::vector<Entry> heapStack;
+		Entry* stack = localStack;
+		if (m_stackSize > kLocalStackSize)
+		{
+			heapStack.resize(m_stackSize);
+			stack = heapStack.data();
+		}
+		int stackSize = 0;
+		stack[stackSize++] = { 0, 0.f };
+		while (stackSize)
+		{
+			const Entry e = stack[--stackSize];
+			if (e.tEnter > tMax)
+				continue; // Found a closer hit since this node was pushed
+			const Node& node = m_nodes[e.node];
+
+			// Slab test against all 4 children at once.
+			// Operand order matters for NaN handling, same as in AABB::intersect
+			float4 t1x = (node.minX - ox) * nx, t2x = (node.maxX - ox) * nx;
+			float4 t1y = (node.minY - oy) * ny, t2y = (node.maxY - oy) * ny;
+			float4 t1z = (node.minZ - oz) * nz, t2z = (node.maxZ - oz) * nz;
+			float4 tEnter = math::max(math::max(math::min(t1x, t2x), math::min(t1y, t2y)), math::max(math::min(t1z, t2z), float4(0.f)));
+			float4 tLeave = math::min(math::min(math::max(t2x, t1x), math::max(t2y, t1y)), math::min(math::max(t2z, t1z), float4(tMax)));
+			int hits = (tEnter <= tLeave).mask() & node.validMask;
+			if (!hits)
+				continue;
+
+			alignas(16) float enter[4];
+			_mm_store_ps(enter, tEnter.m);
+
+			// Visit leaves right away, and push inner nodes far to near so the nearest is popped first
+			int inner[4];
+			int numInner = 0;
+			while (hits)
+			{
+				int i = std::countr_zero(unsigned(hits));
+				hits &= hits - 1;
+				if (node.count[i])
+					visitLeaf(node.child[i], node.count[i]);
+				else
+				{
+					int j = numInner++;
+					while (j > 0 && enter[inner[j - 1]] < enter[i])
+					{
+						inner[j] = inner[j - 1];
+						--j;
+					}
+					inner[j] = i;
+				}
+			}
+			for (int j = 0; j < numInner; ++j)
+			{
+				assert(stackSize < m_stackSize);
+				stack[stackSize++] = { node.child[inner[j]], enter[inner[j]] };
+			}
+		}
+
+		tHit = tMax;
+		return hitIndex;
+	}
+}
@@ -0,0 +1,593 @@
+#pragma once
+// Dense linear solvers for small systems with compile time sizes, up to ~16x16.
+// Nothing is allocated: factors live inside the solver objects, and every loop has compile time
+// bounds, so they are fully unrolled for small N.
+//
+// LU: partial pivoting, for any non singular square matrix.
+// Cholesky / LDLT: symmetric positive definite matrices, like covariances. LDLT avoids the square
+// roots, and also takes symmetric indefinite matrices as long as no pivot vanishes.
+// QR: Householder reflections, for least squares on tall matrices with full column rank.
+//
+// factor() returns false when a pivot falls below N * epsilon times the largest element, instead of
+// asserting. solve() must only be called after a successful factor().
+//
+// The batched namespace solves thousands of independent systems at once, 8 per AVX2 pass.
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "simd.h"
+#include "vector.h"
+#include "vectorFloat.h"
+
+namespace math
+{
+	// Row major dense matrix
+	template<class T, int rows, int cols = rows>
+	struct DenseMatrix
+	{
+		std::array<T, rows * cols> m;
+
+		constexpr T operator()(int i, int j) const { return m[i * cols + j]; }
+		constexpr T& operator()(int i, int j) { return m[i * cols + j]; }
+
+		static constexpr DenseMatrix zero()
+		{
+			DenseMatrix res{};
+			return res;
+		}
+
+		static constexpr DenseMatrix identity()
+		{
+			DenseMatrix res{};
+			for (int i = 0; i < std::min(rows, cols); ++i)
+				res(i, i) = T(1);
+			return res;
+		}
+
+		constexpr Vector<T, rows> operator*(const Vector<T, cols>& v) const
+		{
+			Vector<T, rows> res{};
+			for (int i = 0; i < rows; ++i)
+			{
+				T acc = 0;
+				for (int j = 0; j < cols; ++j)
+					acc += (*this)(i, j) * v[j];
+				res[i] = acc;
+			}
+			return res;
+		}
+	};
+
+	namespace detail
+	{
+		// Pivots below this are treated as zero
+		template<class T, int rows, int cols>
+		T singularTolerance(const DenseMatrix<T, rows, cols>& a)
+		{
+			T scale = 0;
+			for (T x : a.m)
+				scale = std::max(scale, std::abs(x));
+			return scale * std::max(rows, cols) * std::numeric_limits<T>::epsilon();
+		}
+	}
+
+	//---------------------------------------------------------------------------------------------
+	template<class T, int N>
+	class LU
+	{
+	public:
+		LU() = default;
+		explicit LU(const DenseMatrix<T, N>& a) { factor(a); }
+
+		bool factor(const DenseMatrix<T, N>& a)
+		{
+			m_lu = a;
+			m_sign = 1;
+			for (int i = 0; i < N; ++i)
+				m_perm[i] = i;
+
+			const T tiny = detail::singularTolerance(a);
+			m_valid = false;
+			for (int k = 0; k < N; ++k)
+			{
+				// Best pivot in the column
+				int p = k;
+				T best = std::abs(m_lu(k, k));
+				for (int i = k + 1; i < N; ++i)
+				{
+					if (std::abs(m_lu(i, k)) > best)
+					{
+						best = std::abs(m_lu(i, k));
+						p = i;
+					}
+				}
+				if (!(best > tiny))
+					return false;
+
+				if (p != k)
+				{
+					for (int j = 0; j < N; ++j)
+						std::swap(m_lu(k, j), m_lu(p, j));
+					std::swap(m_perm[k], m_perm[p]);
+					m_sign = -m_sign;
+				}
+
+				const T invPivot = 1 / m_lu(k, k);
+				for (int i = k + 1; i < N; ++i)
+				{
+					const T l = m_lu(i, k) * invPivot;
+					m_lu(i, k) = l;
+					for (int j = k + 1; j < N; ++j)
+						m_lu(i, j) -= l * m_lu(k, j);
+				}
+			}
+			m_valid = true;
+			return true;
+		}
+
+		bool valid() const { return m_valid; }
+
+		Vector<T, N> solve(const Vector<T, N>& b) const
+		{
+			assert(m_valid);
+			Vector<T, N> x{};
+			// L y = P b, with a unit diagonal
+			for (int i = 0; i < N; ++i)
+			{
+				T acc = b[m_perm[i]];
+				for (int j = 0; j < i; ++j)
+					acc -= m_lu(i, j) * x[j];
+				x[i] = acc;
+			}
+			// U x = y
+			for (int i = N - 1; i >= 0; --i)
+			{
+				T acc = x[i];
+				for (int j = i + 1; j < N; ++j)
+					acc -= m_lu(i, j) * x[j];
+				x[i] = acc / m_lu(i, i);
+			}
+			return x;
+		}
+
+		T determinant() const
+		{
+			if (!m_valid)
+				return 0;
+			T det = T(m_sign);
+			for (int i = 0; i < N; ++i)
+				det *= m_lu(i, i);
+			return det;
+		}
+
+		DenseMatrix<T, N> inverse() const
+		{
+			DenseMatrix<T, N> inv;
+			for (int j = 0; j < N; ++j)
+			{
+				Vector<T, N> e(T(0));
+				e[j] = 1;
+				const auto col = solve(e);
+				for (int i = 0; i < N; ++i)
+					inv(i, j) = col[i];
+			}
+			return inv;
+		}
+
+	private:
+		DenseMatrix<T, N> m_lu; // Unit lower triangle is L, upper triangle is U
+		std::array<int, N> m_perm; // Row i of LU is row m_perm[i] of the input
+		int m_sign = 1;
+		bool m_valid = false;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// A = L L^T. Only the lower triangle of A is read.
+	template<class T, int N>
+	class Cholesky
+	{
+	public:
+		Cholesky() = default;
+		explicit Cholesky(const DenseMatrix<T, N>& a) { factor(a); }
+
+		// False if A isn't positive definite
+		bool factor(const DenseMatrix<T, N>& a)
+		{
+			const T tiny = detail::singularTolerance(a);
+			m_valid = false;
+			m_l = DenseMatrix<T, N>::zero();
+			for (int j = 0; j < N; ++j)
+			{
+				T d = a(j, j);
+				for (int k = 0; k < j; ++k)
+					d -= m_l(j, k) * m_l(j, k);
+				if (!(d > tiny))
+					return false;
+				const T ljj = std::sqrt(d);
+				m_l(j, j) = ljj;
+
+				const T inv = 1 / ljj;
+				for (int i = j + 1; i < N; ++i)
+				{
+					T acc = a(i, j);
+					for (int k = 0; k < j; ++k)
+						acc -= m_l(i, k) * m_l(j, k);
+					m_l(i, j) = acc * inv;
+				}
+			}
+			m_valid = true;
+			return true;
+		}
+
+		bool valid() const { return m_valid; }
+		const DenseMatrix<T, N>& L() const { return m_l; }
+
+		Vector<T, N> solve(const Vector<T, N>& b) const
+		{
+			assert(m_valid);
+			Vector<T, N> x{};
+			for (int i = 0; i < N; ++i)
+			{
+				T acc = b[i];
+				for (int j = 0; j < i; ++j)
+					acc -= m_l(i, j) * x[j];
+				x[i] = acc / m_l(i, i);
+			}
+			for (int i = N - 1; i >= 0; --i)
+			{
+				T acc = x[i];
+				for (int j = i + 1; j < N; ++j)
+					acc -= m_l(j, i) * x[j];
+				x[i] = acc / m_l(i, i);
+			}
+			return x;
+		}
+
+	private:
+		DenseMatrix<T, N> m_l;
+		bool m_valid = false;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// A = L D L^T, with unit lower triangular L. Only the lower triangle of A is read.
+	template<class T, int N>
+	class LDLT
+	{
+	public:
+		LDLT() = default;
+		explicit LDLT(const DenseMatrix<T, N>& a) { factor(a); }
+
+		// False if a pivot vanishes
+		bool factor(const DenseMatrix<T, N>& a)
+		{
+			const T tiny = detail::singularTolerance(a);
+			m_valid = false;
+			m_l = DenseMatrix<T, N>::identity();
+			for (int j = 0; j < N; ++j)
+			{
+				// L(j, k) * D(k), reused by every row below
+				std::array<T, N> ld;
+				T d = a(j, j);
+				for (int k = 0; k < j; ++k)
+				{
+					ld[k] = m_l(j, k) * m_d[k];
+					d -= ld[k] * m_l(j, k);
+				}
+				if (!(std::abs(d) > tiny))
+					return false;
+				m_d[j] = d;
+
+				const T inv = 1 / d;
+				for (int i = j + 1; i < N; ++i)
+				{
+					T acc = a(i, j);
+					for (int k = 0; k < j; ++k)
+						acc -= m_l(i, k) * ld[k];
+					m_l(i, j) = acc * inv;
+				}
+			}
+			m_valid = true;
+			return true;
+		}
+
+		bool valid() const { return m_valid; }
+		const DenseMatrix<T, N>& L() const { return m_l; }
+		const std::array<T, N>& D() const { return m_d; }
+
+		Vector<T, N> solve(const Vector<T, N>& b) const
+		{
+			assert(m_valid);
+			Vector<T, N> x{};
+			for (int i = 0; i < N; ++i)
+			{
+				T acc = b[i];
+				for (int j = 0; j < i; ++j)
+					acc -= m_l(i, j) * x[j];
+				x[i] = acc;
+			}
+			for (int i = 0; i < N; ++i)
+				x[i] /= m_d[i];
+			for (int i = N - 1; i >= 0; --i)
+			{
+				T acc = x[i];
+				for (int j = i + 1; j < N; ++j)
+					acc -= m_l(j, i) * x[j];
+				x[i] = acc;
+			}
+			return x;
+		}
+
+	private:
+		DenseMatrix<T, N> m_l;
+		std::array<T, N> m_d;
+		bool m_valid = false;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// A = Q R for rows >= cols, with Q stored as Householder vectors.
+	// solve() gives the least squares solution, exact for square systems.
+	template<class T, int rows, int cols = rows>
+	class QR
+	{
+		static_assert(rows >= cols);
+	public:
+		QR() = default;
+		explicit QR(const DenseMatrix<T, rows, cols>& a) { factor(a); }
+
+		// False if A is rank deficient
+		bool factor(const DenseMatrix<T, rows, cols>& a)
+		{
+			m_qr = a;
+			const T tiny = detail::singularTolerance(a);
+			m_valid = false;
+			for (int k = 0; k < cols; ++k)
+			{
+				T sqNorm = 0;
+				for (int i = k; i < rows; ++i)
+					sqNorm += m_qr(i, k) * m_qr(i, k);
+				const T norm = std::sqrt(sqNorm);
+				if (!(norm > tiny))
+					return false;
+
+				// Reflect the column onto alpha e_k, with the sign that avoids cancellation.
+				// v = x - alpha e_k is stored in place, and v^T v = -2 alpha v_k.
+				const T alpha = m_qr(k, k) > 0 ? -norm : norm;
+				m_qr(k, k) -= alpha;
+				m_rDiag[k] = alpha;
+				m_beta[k] = -1 / (alpha * m_qr(k, k));
+
+				for (int j = k + 1; j < cols; ++j)
+				{
+					T s = 0;
+					for (int i = k; i < rows; ++i)
+						s += m_qr(i, k) * m_qr(i, j);
+					s *= m_beta[k];
+					for (int i = k; i < rows; ++i)
+						m_qr(i, j) -= s * m_qr(i, k);
+				}
+			}
+			m_valid = true;
+			return true;
+		}
+
+		bool valid() const { return m_valid; }
+
+		// Minimizes |A x - b|
+		Vector<T, cols> solve(const Vector<T, rows>& b) const
+		{
+			assert(m_valid);
+			// Q^T b
+			Vector<T, rows> qtb = b;
+			for (int k = 0; k < cols; ++k)
+			{
+				T s = 0;
+				for (int i = k; i < rows; ++i)
+					s += m_qr(i, k) * qtb[i];
+				s *= m_beta[k];
+				for (int i = k; i < rows; ++i)
+					qtb[i] -= s * m_qr(i, k);
+			}
+			// R x = Q^T b
+			Vector<T, cols> x{};
+			for (int i = cols - 1; i >= 0; --i)
+			{
+				T acc = qtb[i];
+				for (int j = i + 1; j < cols; ++j)
+					acc -= m_qr(i, j) * x[j];
+				x[i] = acc / m_rDiag[i];
+			}
+			return x;
+		}
+
+	private:
+		DenseMatrix<T, rows, cols> m_qr; // R above the diagonal, Householder vectors on and below
+		std::array<T, cols> m_rDiag;
+		std::array<T, cols> m_beta; // 2 / v^T v
+		bool m_valid = false;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// Many independent N x N systems A x = b, interleaved so that consecutive systems sit in
+	// consecutive floats: element (i, j) of system s is a[(i * N + j) * count + s], and element i
+	// of its right hand side is b[i * count + s]. x overwrites b. Systems that can't be factored
+	// get NaN solutions.
+	namespace batched
+	{
+		namespace detail
+		{
+			using Kernel = void (*)(const float* a, float* b, size_t count, size_t first);
+
+			template<template<class, int> class Solver, int N>
+			void solveScalar(const float* a, float* b, size_t count, size_t first)
+			{
+				for (size_t s = first; s < count; ++s)
+				{
+					DenseMatrix<float, N> A;
+					Vector<float, N> B;
+					for (int i = 0; i < N * N; ++i)
+						A.m[i] = a[i * count + s];
+					for (int i = 0; i < N; ++i)
+						B[i] = b[i * count + s];
+
+					const Solver<float, N> solver(A);
+					const auto x = solver.valid() ? solver.solve(B) : Vector<float, N>(std::numeric_limits<float>::quiet_NaN());
+					for (int i = 0; i < N; ++i)
+						b[i * count + s] = x[i];
+				}
+			}
+
+			MATH_AVX2_BEGIN
+			// Largest magnitude of every lane, for the singularity tolerance
+			template<int N>
+			float8 scale8(const float8* A)
+			{
+				float8 scale = 0.f;
+				for (int i = 0; i < N * N; ++i)
+					scale = max(scale, abs(A[i]));
+				return scale * float(N * std::numeric_limits<float>::epsilon());
+			}
+
+			// Pivoting can't branch per lane, so rows are swapped with blends while searching
+			template<int N>
+			void luSolveAvx2(const float* a, float* b, size_t count, size_t)
+			{
+				const size_t numBlocks = count / 8;
+				for (size_t blk = 0; blk < numBlocks; ++blk)
+				{
+					const size_t s = blk * 8;
+					float8 A[N * N], B[N];
+					for (int i = 0; i < N * N; ++i)
+						A[i] = float8::loadu(&a[i * count + s]);
+					for (int i = 0; i < N; ++i)
+						B[i] = float8::loadu(&b[i * count + s]);
+
+					const float8 tiny = scale8<N>(A);
+					mask8 valid(true);
+					for (int k = 0; k < N; ++k)
+					{
+						for (int i = k + 1; i < N; ++i)
+						{
+							const mask8 swap = abs(A[i * N + k]) > abs(A[k * N + k]);
+							if (swap.none())
+								continue;
+							for (int j = k; j < N; ++j)
+							{
+								const float8 t = A[k * N + j];
+								A[k * N + j] = select(swap, A[i * N + j], t);
+								A[i * N + j] = select(swap, t, A[i * N + j]);
+							}
+							const float8 t = B[k];
+							B[k] = select(swap, B[i], t);
+							B[i] = select(swap, t, B[i]);
+						}
+						valid = valid & (abs(A[k * N + k]) > tiny);
+
+						const float8 invPivot = 1.f / A[k * N + k];
+						for (int i = k + 1; i < N; ++i)
+						{
+							const float8 l = A[i * N + k] * invPivot;
+							for (int j = k + 1; j < N; ++j)
+								A[i * N + j] -= l * A[k * N + j];
+							B[i] -= l * B[k];
+						}
+					}
+
+					const float8 nan = std::numeric_limits<float>::quiet_NaN();
+					for (int i = N - 1; i >= 0; --i)
+					{
+						float8 acc = B[i];
+						for (int j = i + 1; j < N; ++j)
+							acc -= A[i * N + j] * B[j];
+						B[i] = acc / A[i * N + i];
+					}
+					for (int i = 0; i < N; ++i)
+						select(valid, B[i], nan).storeu(&b[i * count + s]);
+				}
+				solveScalar<LU, N>(a, b, count, numBlocks * 8);
+			}
+
+			template<int N>
+			void choleskySolveAvx2(const float* a, float* b, size_t count, size_t)
+			{
+				const size_t numBlocks = count / 8;
+				for (size_t blk = 0; blk < numBlocks; ++blk)
+				{
+					const size_t s = blk * 8;
+					float8 A[N * N], B[N];
+					for (int i = 0; i < N; ++i)
+					{
+						for (int j = 0; j <= i; ++j)
+							A[i * N + j] = float8::loadu(&a[(i * N + j) * count + s]);
+						B[i] = float8::loadu(&b[i * count + s]);
+					}
+
+					float8 scale = 0.f;
+					for (int i = 0; i < N; ++i)
+						for (int j = 0; j <= i; ++j)
+							scale = max(scale, abs(A[i * N + j]));
+					const float8 tiny = scale * float(N * std::numeric_limits<float>::epsilon());
+
+					// L overwrites the lower triangle, and 1 / L(j, j) is kept for the solves
+					mask8 valid(true);
+					float8 invDiag[N];
+					for (int j = 0; j < N; ++j)
+					{
+						float8 d = A[j * N + j];
+						for (int k = 0; k < j; ++k)
+							d -= A[j * N + k] * A[j * N + k];
+						valid = valid & (d > tiny);
+						invDiag[j] = 1.f / sqrt(d);
+						for (int i = j + 1; i < N; ++i)
+						{
+							float8 acc = A[i * N + j];
+							for (int k = 0; k < j; ++k)
+								acc -= A[i * N + k] * A[j * N + k];
+							A[i * N + j] = acc * invDiag[j];
+						}
+					}
+
+					for (int i = 0; i < N; ++i)
+					{
+						float8 acc = B[i];
+						for (int j = 0; j < i; ++j)
+							acc -= A[i * N + j] * B[j];
+						B[i] = acc * invDiag[i];
+					}
+					for (int i = N - 1; i >= 0; --i)
+					{
+						float8 acc = B[i];
+						for (int j = i + 1; j < N; ++j)
+							acc -= A[j * N + i] * B[j];
+						B[i] = acc * invDiag[i];
+					}
+
+					const float8 nan = std::numeric_limits<float>::quiet_NaN();
+					for (int i = 0; i < N; ++i)
+						select(valid, B[i], nan).storeu(&b[i * count + s]);
+				}
+				solveScalar<Cholesky, N>(a, b, count, numBlocks * 8);
+			}
+			MATH_AVX2_END
+		}
+
+		template<int N>
+		void luSolve(const float* a, float* b, size_t count)
+		{
+			static const auto kernel = pickKernel<detail::Kernel>(&detail::solveScalar<LU, N>, nullptr, &detail::luSolveAvx2<N>);
+			kernel(a, b, count, 0);
+		}
+
+		// Only the lower triangles are read
+		template<int N>
+		void choleskySolve(const float* a, float* b, size_t count)
+		{
+			static const auto kernel = pickKernel<detail::Kernel>(&detail::solveScalar<Cholesky, N>, nullptr, &detail::choleskySolveAvx2<N>);
+			kernel(a, b, count, 0);
+		}
+	}
+}	// namespace math
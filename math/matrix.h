@@ -19,10 +19,12 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <initializer_list>
 #include "aabb.h"
 #include "vector.h"
+#include "vectorFloat.h"
 
 #include <DirectXMath.h>
 
@@ -34,45 +36,47 @@ namespace math
 		using Column = Vec2<T>;
 
 		Mat22() = default;
-		Mat22(T a00, T a01, T a10, T a11)
+		constexpr Mat22(T a00, T a01, T a10, T a11)
 			: m{{a00,a10}, {a01,a11}}
 		{}
 
-		auto det() const
+		constexpr auto det() const
 		{
 			return m[0][0] * m[1][1] - m[1][0] * m[0][1];
 		}
 
-		Mat22 operator+(const Mat22& b) const
+		constexpr Mat22 operator+(const Mat22& b) const
 		{
+			const Mat22& a = *this;
 			return Mat22(
-				m[0][0] + b.m[0][0], m[0][1] + b.m[0][1],
-				m[1][0] + b.m[1][0], m[1][1] + b.m[1][1]
+				a(0, 0) + b(0, 0), a(0, 1) + b(0, 1),
+				a(1, 0) + b(1, 0), a(1, 1) + b(1, 1)
 			);
 		}
 
-		Mat22 operator-(const Mat22& b) const
+		constexpr Mat22 operator-(const Mat22& b) const
 		{
+			const Mat22& a = *this;
 			return Mat22(
-				m[0][0] + b.m[0][0], m[0][1] + b.m[0][1],
-				m[1][0] + b.m[1][0], m[1][1] + b.m[1][1]
+				a(0, 0) - b(0, 0), a(0, 1) - b(0, 1),
+				a(1, 0) - b(1, 0), a(1, 1) - b(1, 1)
 			);
 		}
 
-		Vec2<T> operator*(const Vec2<T>& v) const
+		constexpr Vec2<T> operator*(const Vec2<T>& v) const
 		{
 			Vec2<T> result;
 			result[0] = m[0][0] * v[0] + m[1][0] * v[1];
-			result[1] = m[0][0] * v[0] + m[1][0] * v[1];
+			result[1] = m[0][1] * v[0] + m[1][1] * v[1];
 			return result;
 		}
 
-		double operator()(size_t row, size_t col) const
+		constexpr T operator()(size_t row, size_t col) const
 		{
 			return m[col][row];
 		}
 
-		double& operator()(size_t row, size_t col)
+		constexpr T& operator()(size_t row, size_t col)
 		{
 			return m[col][row];
 		}
@@ -81,7 +85,7 @@ namespace math
 	};
 
 	template<class T>
-	Mat22<T> operator*(const Mat22<T>& a, const Mat22<T>& b)
+	constexpr Mat22<T> operator*(const Mat22<T>& a, const Mat22<T>& b)
 	{
 		Mat22<T> result;
 		result(0, 0) = a(0, 0) * b(0, 0) + a(0, 1) * b(1, 0);
@@ -92,7 +96,7 @@ namespace math
 	}
 
 	template<class T>
-	Vec2<T> operator*(const Vec2<T>& v, const Mat22<T>& m)
+	constexpr Vec2<T> operator*(const Vec2<T>& v, const Mat22<T>& m)
 	{
 		Vec2<T> result(
 			v[0]*m(0,0) + v[1]*m(0,1),
@@ -103,11 +107,17 @@ namespace math
 
 	using Mat22d = Mat22<double>;
 
+	// The constructor takes rows, the storage holds columns. Non symmetric operands catch a mix up.
+	static_assert((Mat22d(1, 2, 3, 4) + Mat22d(0, 1, 1, 0))(0, 1) == 3);
+	static_assert((Mat22d(1, 2, 3, 4) - Mat22d(0, 1, 1, 0))(0, 1) == 1);
+	static_assert((Mat22d(1, 2, 3, 4) - Mat22d(0, 1, 1, 0))(1, 0) == 2);
+	static_assert((Mat22d(1, 2, 3, 4) * Vec2d(1, 0))[1] == 3);
+
 	class alignas(4 * sizeof(float)) Matrix34f
 	{
 	public:
 		Matrix34f() = default;
-		Matrix34f(std::initializer_list<float> il)
+		constexpr Matrix34f(std::initializer_list<float> il)
 		{
 			assert(il.size() == 12);
 
@@ -116,15 +126,17 @@ namespace math
 				m[i] = *iter++;
 		}
 
-		Matrix34f(float x)
+		constexpr Matrix34f(float x)
 		{
 			for(auto i = 0; i < 12; ++i)
 				m[i] = x;
 		}
 
 		Matrix34f inverse() const;
+		// Only valid when the 3x3 part is a rotation, i.e. orthonormal
+		Matrix34f inverseRigid() const;
 
-		static Matrix34f identity()
+		static constexpr Matrix34f identity()
 		{
 			Matrix34f x;
 			for(int i = 0; i < 3; ++i)
@@ -134,11 +146,11 @@ namespace math
 		}
 
 		Vec3f& position() { return reinterpret_cast<Vec3f&>((*this)(0,3)); }
-		Vec3f position() const {
-			return col<3>();
+		constexpr Vec3f position() const {
+			return Vec3f(m[9], m[10], m[11]);
 		}
 
-		Matrix34f operator*(const Matrix34f& b) const
+		constexpr Matrix34f operator*(const Matrix34f& b) const
 		{
 			Matrix34f res;
 			for(int i = 0; i < 3; ++i)
@@ -173,7 +185,7 @@ namespace math
             return AABB(newMin, newMax);
         }
 
-		Vec3f transformPos(const Vec3f& v) const
+		constexpr Vec3f transformPos(const Vec3f& v) const
 		{
 			Vec3f res;
 			for(int i = 0; i < 3; ++i)
@@ -201,7 +213,7 @@ namespace math
             return reinterpret_cast<Vec3f&>(m[3 * i]);
         }
 
-		Vec3f transformDir(const Vec3f& v) const
+		constexpr Vec3f transformDir(const Vec3f& v) const
 		{
 			Vec3f res;
 			for(int i = 0; i < 3; ++i)
@@ -214,12 +226,17 @@ namespace math
 			return res;
 		}
 
-		float& operator()(int i, int j)
+		// Batched transforms of count points stored as separate x, y and z arrays.
+		// Outputs may alias the inputs.
+		void transformPos(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const;
+		void transformDir(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const;
+
+		constexpr float& operator()(int i, int j)
 		{
 			return m[3*j+i];
 		}
 
-		float operator()(int i, int j) const
+		constexpr float operator()(int i, int j) const
 		{
 			return m[3*j+i];
 		}
@@ -233,7 +250,7 @@ namespace math
 	{
 	public:
 		Matrix44f() = default;
-		Matrix44f(std::initializer_list<float> il)
+		constexpr Matrix44f(std::initializer_list<float> il)
 		{
 			assert(il.size() == 16);
 
@@ -241,10 +258,10 @@ namespace math
 			for (size_t i = 0; i < il.size(); ++i)
 				m[i] = *iter++;
 		}
-		Matrix44f(const Matrix44f&) = default;
+		constexpr Matrix44f(const Matrix44f&) = default;
 
 		// Assuming an implicit (0,0,0,1) 4th row
-		explicit Matrix44f(const Matrix34f& x)
+		explicit constexpr Matrix44f(const Matrix34f& x)
 		{
 			*this = Matrix44f::identity();
 			for (int i = 0; i < 3; ++i)
@@ -252,9 +269,10 @@ namespace math
 					(*this)(i, j) = x(i, j);
 		}
 
-		explicit Matrix44f(const std::array<float,16>& colMajorArray)
+		explicit constexpr Matrix44f(const std::array<float,16>& colMajorArray)
 		{
-			memcpy(m, colMajorArray.data(), sizeof(Matrix44f));
+			for (size_t i = 0; i < 16; ++i)
+				m[i] = colMajorArray[i];
 		}
 
 		explicit Matrix44f(const DirectX::XMMATRIX& rowMajorMtx)
@@ -298,13 +316,14 @@ namespace math
 			return x;
 		}
 
-		Matrix44f inverse() const
+		// Generic inverse through LU decomposition. See factorizationLU
+		Matrix44f inverseLU() const
 		{
 			Matrix44f inv;
 			Matrix44f L, U;
 			std::array<int,4> P;
 			factorizationLU(L,U,P);
-			Matrix44f pb = Matrix44f(0.f);
+			Matrix44f pb = Matrix44f(std::array<float, 16>{}); // All zeros
 			for(int i = 0; i < 4; ++i)
 			{
 				pb(i,P[i]) = 1.f;
@@ -320,7 +339,10 @@ namespace math
 			return inv;
 		}
 
-		bool operator== (const Matrix44f& x) const
+		// Closed form inverse, from the cofactors
+		Matrix44f inverse() const;
+
+		constexpr bool operator== (const Matrix44f& x) const
 		{
 			for(int i = 0; i < 3; ++i)
 				for(int j = 0; j < 4; ++j)
@@ -328,7 +350,7 @@ namespace math
 			return true;
 		}
 
-		static Matrix44f identity()
+		static constexpr Matrix44f identity()
 		{
 			Matrix44f x;
 			for(int i = 0; i < 4; ++i)
@@ -337,7 +359,7 @@ namespace math
 			return x;
 		}
 
-		Matrix44f operator*(const Matrix44f& b) const
+		constexpr Matrix44f operator*(const Matrix44f& b) const
 		{
 			Matrix44f res;
 			for(int i = 0; i < 4; ++i)
@@ -354,7 +376,7 @@ namespace math
 			return res;
 		}
 
-		Vec4f operator*(const Vec4f& b) const
+		constexpr Vec4f operator*(const Vec4f& b) const
 		{
 			Vec4f res;
 			for(int i = 0; i < 4; ++i)
@@ -368,17 +390,17 @@ namespace math
 			return res;
 		}
 
-		float& operator()(int i, int j)
+		constexpr float& operator()(int i, int j)
 		{
 			return m[4*j+i];
 		}
 
-		float operator()(int i, int j) const
+		constexpr float operator()(int i, int j) const
 		{
 			return m[4*j+i];
 		}
 
-		float element(int i, int j) const
+		constexpr float element(int i, int j) const
 		{
 			return m[4*j+i];
 		}
@@ -391,7 +413,7 @@ namespace math
 		float m[16];
 	};
 
-	inline Matrix44f transpose(const Matrix44f x)
+	constexpr Matrix44f transpose(const Matrix44f x)
 	{
 		Matrix44f result;
 		for (int i = 0; i < 4; ++i)
@@ -404,17 +426,133 @@ namespace math
 		return result;
 	}
 
+	inline Matrix44f Matrix44f::inverse() const
+	{
+		// Expand along pairs of rows. s are the 2x2 minors of rows 0 and 1, c those of rows 2 and 3.
+		// Each column of the adjugate is then a signed sum of three products of one row and those minors.
+		float4 r0(_mm_load_ps(&m[0]));
+		float4 r1(_mm_load_ps(&m[4]));
+		float4 r2(_mm_load_ps(&m[8]));
+		float4 r3(_mm_load_ps(&m[12]));
+		_MM_TRANSPOSE4_PS(r0.m, r1.m, r2.m, r3.m); // Columns to rows
+
+		// Minors for column pairs (2,3)(2,3)(1,3)(1,2), (1,3)(0,3)(0,3)(0,2) and (1,2)(0,2)(0,1)(0,1)
+		auto minors = [](float4 a, float4 b, float4& A, float4& B, float4& C) {
+			A = a.shuffle<2,2,1,1>() * b.shuffle<3,3,3,2>() - b.shuffle<2,2,1,1>() * a.shuffle<3,3,3,2>();
+			B = a.shuffle<1,0,0,0>() * b.shuffle<3,3,3,2>() - b.shuffle<1,0,0,0>() * a.shuffle<3,3,3,2>();
+			C = a.shuffle<1,0,0,0>() * b.shuffle<2,2,1,1>() - b.shuffle<1,0,0,0>() * a.shuffle<2,2,1,1>();
+		};
+		float4 sA, sB, sC, cA, cB, cC;
+		minors(r0, r1, sA, sB, sC);
+		minors(r2, r3, cA, cB, cC);
+
+		auto cofactors = [](float4 r, float4 A, float4 B, float4 C) {
+			return r.shuffle<1,0,0,0>() * A - r.shuffle<2,2,1,1>() * B + r.shuffle<3,3,3,2>() * C;
+		};
+		const float4 signPNPN(_mm_castsi128_ps(_mm_set_epi32(int(0x80000000), 0, int(0x80000000), 0)));
+		const float4 signNPNP(_mm_castsi128_ps(_mm_set_epi32(0, int(0x80000000), 0, int(0x80000000))));
+		float4 adj0(_mm_xor_ps(cofactors(r1, cA, cB, cC).m, signPNPN.m));
+		float4 adj1(_mm_xor_ps(cofactors(r0, cA, cB, cC).m, signNPNP.m));
+		float4 adj2(_mm_xor_ps(cofactors(r3, sA, sB, sC).m, signPNPN.m));
+		float4 adj3(_mm_xor_ps(cofactors(r2, sA, sB, sC).m, signNPNP.m));
+
+		float4 d = r0 * adj0;
+		d = d + d.shuffle<2,3,0,1>();
+		d = d + d.shuffle<1,0,3,2>();
+		assert(d.x() != 0.f);
+		const float4 rcpDet = float4(1.f) / d;
+
+		Matrix44f inv;
+		_mm_store_ps(&inv.m[0], (adj0 * rcpDet).m);
+		_mm_store_ps(&inv.m[4], (adj1 * rcpDet).m);
+		_mm_store_ps(&inv.m[8], (adj2 * rcpDet).m);
+		_mm_store_ps(&inv.m[12], (adj3 * rcpDet).m);
+		return inv;
+	}
+
 	inline Matrix34f Matrix34f::inverse() const
 	{
+		// Rows of the inverse of [a b c] are the cross products of its columns over the determinant
+		const Vec3f& a = col<0>();
+		const Vec3f& b = col<1>();
+		const Vec3f& c = col<2>();
+		const Vec3f bc = cross(b, c);
+		const Vec3f ca = cross(c, a);
+		const Vec3f ab = cross(a, b);
+		const float det = dot(a, bc);
+		assert(det != 0.f);
+		const float rcpDet = 1.f / det;
+
 		Matrix34f inv;
-		auto x = Matrix44f(*this);
-		auto xi = x.inverse();
-		for(int j = 0; j < 4; ++j)
-			for(int i = 0; i < 3; ++i)
-				inv(i,j) = xi(i,j);
+		for(int j = 0; j < 3; ++j)
+		{
+			inv(0,j) = bc[j] * rcpDet;
+			inv(1,j) = ca[j] * rcpDet;
+			inv(2,j) = ab[j] * rcpDet;
+		}
+		inv.col<3>() = -inv.transformDir(position());
+		return inv;
+	}
+
+	inline Matrix34f Matrix34f::inverseRigid() const
+	{
+		Matrix34f inv;
+		for(int i = 0; i < 3; ++i)
+			for(int j = 0; j < 3; ++j)
+				inv(i,j) = (*this)(j,i);
+		inv.col<3>() = -inv.transformDir(position());
 		return inv;
 	}
 
+	inline void Matrix34f::transformPos(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const
+	{
+		const float4 m00(m[0]), m10(m[1]), m20(m[2]);
+		const float4 m01(m[3]), m11(m[4]), m21(m[5]);
+		const float4 m02(m[6]), m12(m[7]), m22(m[8]);
+		const float4 t0(m[9]), t1(m[10]), t2(m[11]);
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			const float4 vx(_mm_loadu_ps(x + i));
+			const float4 vy(_mm_loadu_ps(y + i));
+			const float4 vz(_mm_loadu_ps(z + i));
+			_mm_storeu_ps(outX + i, (m00 * vx + m01 * vy + m02 * vz + t0).m);
+			_mm_storeu_ps(outY + i, (m10 * vx + m11 * vy + m12 * vz + t1).m);
+			_mm_storeu_ps(outZ + i, (m20 * vx + m21 * vy + m22 * vz + t2).m);
+		}
+		for(; i < count; ++i)
+		{
+			const Vec3f p = transformPos(Vec3f(x[i], y[i], z[i]));
+			outX[i] = p.x();
+			outY[i] = p.y();
+			outZ[i] = p.z();
+		}
+	}
+
+	inline void Matrix34f::transformDir(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const
+	{
+		const float4 m00(m[0]), m10(m[1]), m20(m[2]);
+		const float4 m01(m[3]), m11(m[4]), m21(m[5]);
+		const float4 m02(m[6]), m12(m[7]), m22(m[8]);
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			const float4 vx(_mm_loadu_ps(x + i));
+			const float4 vy(_mm_loadu_ps(y + i));
+			const float4 vz(_mm_loadu_ps(z + i));
+			_mm_storeu_ps(outX + i, (m00 * vx + m01 * vy + m02 * vz).m);
+			_mm_storeu_ps(outY + i, (m10 * vx + m11 * vy + m12 * vz).m);
+			_mm_storeu_ps(outZ + i, (m20 * vx + m21 * vy + m22 * vz).m);
+		}
+		for(; i < count; ++i)
+		{
+			const Vec3f d = transformDir(Vec3f(x[i], y[i], z[i]));
+			outX[i] = d.x();
+			outY[i] = d.y();
+			outZ[i] = d.z();
+		}
+	}
+
 	using Mat34f = Matrix34f;
 	using Mat44f = Matrix44f;
 
@@ -0,0 +1,271 @@
+#pragma once
+// Counter based random numbers.
+// Value i of a stream is squirrelNoise(i, key), so there is no state to share between threads:
+// any sample can be computed directly, streams jump ahead in O(1), and substreams with unrelated
+// keys can be handed to each thread or trajectory. Batch fills produce exactly the same values as
+// the scalar calls, whichever instruction set they run on.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.h"
+#include "noise.h"
+#include "simd.h"
+#include "vector.h"
+#include "vectorFloat.h"
+
+namespace math
+{
+	class RandomStream
+	{
+	public:
+		explicit RandomStream(uint32_t seed = 0, uint32_t stream = 0)
+			: m_key(squirrelNoise(int(stream), int(seed)))
+		{}
+
+		// Independent stream, e.g. one per thread or per trajectory
+		RandomStream substream(uint32_t index) const
+		{
+			RandomStream s;
+			s.m_key = squirrelNoise(int(index), m_key ^ int(0x9E3779B9));
+			return s;
+		}
+
+		void jump(uint32_t numValues) { m_counter += numValues; }
+		uint32_t counter() const { return m_counter; }
+		void setCounter(uint32_t counter) { m_counter = counter; }
+
+		// Each call consumes one counter value. nextUint has 31 random bits, the sign bit is always clear
+		uint32_t nextUint() { return uint32_t(squirrelNoise(int(m_counter++), m_key)); }
+		float uniform() { return toUniform(nextUint()); } // [0,1)
+		float uniform(float a, float b) { return a + (b - a) * uniform(); }
+		float normal() { return normalAt(m_key, m_counter++); } // Ziggurat
+		Vec3f unitVector() // Consumes two counter values
+		{
+			const float z = 2 * uniform() - 1;
+			const float phi = TwoPi * uniform();
+			const float r = std::sqrt(std::max(0.f, 1 - z * z));
+			return Vec3f(r * std::cos(phi), r * std::sin(phi), z);
+		}
+
+		// Same values as n consecutive calls, 8 or 16 at a time when the CPU allows it
+		void fillUniform(float* out, size_t n);
+		void fillNormal(float* out, size_t n);
+		void fillUnitVectors(float* x, float* y, float* z, size_t n);
+
+		// Building blocks for custom kernels
+		static float toUniform(uint32_t bits) { return float(bits & ((1 << 24) - 1)) * (1.f / (1 << 24)); }
+		static float normalAt(int key, uint32_t counter);
+
+	private:
+		int m_key = 0;
+		uint32_t m_counter = 0;
+	};
+
+	//---------------------------------------------------------------------------------------------
+	// Ziggurat for the standard normal distribution (Marsaglia & Tsang 2000), 128 layers
+	struct ZigguratTables
+	{
+		int32_t k[128]; // Fast acceptance thresholds on |hz|
+		float w[128]; // hz to x scale
+		float f[128]; // Density at the layer edges
+
+		static const ZigguratTables& get()
+		{
+			static const ZigguratTables tables;
+			return tables;
+		}
+
+		static constexpr double r = 3.442619855899;
+
+	private:
+		ZigguratTables()
+		{
+			const double m1 = 2147483648.0;
+			const double vn = 9.91256303526217e-3;
+			double dn = r, tn = r;
+			const double q = vn / std::exp(-0.5 * dn * dn);
+			k[0] = int32_t((dn / q) * m1);
+			k[1] = 0;
+			w[0] = float(q / m1);
+			w[127] = float(dn / m1);
+			f[0] = 1.f;
+			f[127] = float(std::exp(-0.5 * dn * dn));
+			for (int i = 126; i >= 1; --i)
+			{
+				dn = std::sqrt(-2 * std::log(vn / dn + std::exp(-0.5 * dn * dn)));
+				k[i + 1] = int32_t((dn / tn) * m1);
+				tn = dn;
+				f[i] = float(std::exp(-0.5 * dn * dn));
+				w[i] = float(dn / m1);
+			}
+		}
+	};
+
+	inline float RandomStream::normalAt(int key, uint32_t counter)
+	{
+		// squirrelNoise never sets the sign bit, so shift its 31 bits up to get a signed value
+		const ZigguratTables& z = ZigguratTables::get();
+		int bits = squirrelNoise(int(counter), key);
+		int32_t hz = int32_t(uint32_t(bits) << 1);
+		int iz = bits & 127;
+		if (std::abs(int64_t(hz)) < z.k[iz])
+			return float(hz) * z.w[iz];
+
+		// Rare slow path. Its extra values come from a stream keyed by the sample's own counter,
+		// so the sample stays a pure function of (key, counter).
+		const int slowKey = squirrelNoise(int(counter), key ^ int(0x5BD1E995));
+		int slowCounter = 0;
+		auto uniformOpen = [&] { return (float(squirrelNoise(slowCounter++, slowKey) & ((1 << 24) - 1)) + 0.5f) * (1.f / (1 << 24)); };
+		for (;;)
+		{
+			const float x = float(hz) * z.w[iz];
+			if (iz == 0) // Tail beyond r
+			{
+				float tx, ty;
+				do
+				{
+					tx = -std::log(uniformOpen()) / float(ZigguratTables::r);
+					ty = -std::log(uniformOpen());
+				} while (ty + ty < tx * tx);
+				return hz > 0 ? float(ZigguratTables::r) + tx : -float(ZigguratTables::r) - tx;
+			}
+			if (z.f[iz] + uniformOpen() * (z.f[iz - 1] - z.f[iz]) < std::exp(-0.5f * x * x))
+				return x;
+			bits = squirrelNoise(slowCounter++, slowKey);
+			hz = int32_t(uint32_t(bits) << 1);
+			iz = bits & 127;
+			if (std::abs(int64_t(hz)) < z.k[iz])
+				return float(hz) * z.w[iz];
+		}
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Batch kernels. out[i] is the value for counter0 + i.
+	namespace detail
+	{
+		using RandomFillKernel = void (*)(int key, uint32_t counter0, float* out, size_t n);
+
+		inline void uniformScalar(int key, uint32_t counter0, float* out, size_t n)
+		{
+			for (size_t i = 0; i < n; ++i)
+				out[i] = RandomStream::toUniform(uint32_t(squirrelNoise(int(counter0 + uint32_t(i)), key)));
+		}
+
+		inline void normalScalar(int key, uint32_t counter0, float* out, size_t n)
+		{
+			for (size_t i = 0; i < n; ++i)
+				out[i] = RandomStream::normalAt(key, counter0 + uint32_t(i));
+		}
+
+		// squirrelNoise on 8 positions
+		MATH_TARGET_AVX2 inline __m256i squirrelNoise8(__m256i position, __m256i seed)
+		{
+			__m256i m = _mm256_mullo_epi32(position, _mm256_set1_epi32(int(0xB5297A4D)));
+			m = _mm256_add_epi32(m, seed);
+			m = _mm256_xor_si256(m, _mm256_srai_epi32(m, 8));
+			m = _mm256_mullo_epi32(m, _mm256_set1_epi32(int(0x68E31DA4)));
+			m = _mm256_xor_si256(m, _mm256_slli_epi32(m, 8));
+			m = _mm256_mullo_epi32(m, _mm256_set1_epi32(int(0x1B56C4E9)));
+			return _mm256_xor_si256(m, _mm256_srai_epi32(m, 8));
+		}
+
+		MATH_TARGET_AVX2 inline void uniformAvx2(int key, uint32_t counter0, float* out, size_t n)
+		{
+			const __m256i seed = _mm256_set1_epi32(key);
+			const __m256i mantissa = _mm256_set1_epi32((1 << 24) - 1);
+			const __m256 scale = _mm256_set1_ps(1.f / (1 << 24));
+			__m256i position = _mm256_add_epi32(_mm256_set1_epi32(int(counter0)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256i bits = _mm256_and_si256(squirrelNoise8(position, seed), mantissa);
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(bits), scale));
+				position = _mm256_add_epi32(position, _mm256_set1_epi32(8));
+			}
+			uniformScalar(key, counter0 + uint32_t(i), out + i, n - i);
+		}
+
+		MATH_TARGET_AVX2 inline void normalAvx2(int key, uint32_t counter0, float* out, size_t n)
+		{
+			const ZigguratTables& z = ZigguratTables::get();
+			const __m256i seed = _mm256_set1_epi32(key);
+			__m256i position = _mm256_add_epi32(_mm256_set1_epi32(int(counter0)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				const __m256i bits = squirrelNoise8(position, seed);
+				const __m256i hz = _mm256_slli_epi32(bits, 1);
+				const __m256i iz = _mm256_and_si256(bits, _mm256_set1_epi32(127));
+				const __m256i k = _mm256_i32gather_epi32(z.k, iz, 4);
+				const __m256 w = _mm256_i32gather_ps(z.w, iz, 4);
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(hz), w));
+				// |hz| < k, with INT_MIN never accepted, as in the scalar path
+				const __m256i absHz = _mm256_abs_epi32(hz);
+				const __m256i accepted = _mm256_and_si256(_mm256_cmpgt_epi32(k, absHz), _mm256_cmpgt_epi32(absHz, _mm256_set1_epi32(-1)));
+				int rejected = ~_mm256_movemask_ps(_mm256_castsi256_ps(accepted)) & 0xff;
+				while (rejected)
+				{
+					const int lane = std::countr_zero(unsigned(rejected));
+					out[i + lane] = RandomStream::normalAt(key, counter0 + uint32_t(i + lane));
+					rejected &= rejected - 1;
+				}
+				position = _mm256_add_epi32(position, _mm256_set1_epi32(8));
+			}
+			normalScalar(key, counter0 + uint32_t(i), out + i, n - i);
+		}
+
+		MATH_TARGET_AVX512 inline void uniformAvx512(int key, uint32_t counter0, float* out, size_t n)
+		{
+			const __m512i seed = _mm512_set1_epi32(key);
+			const __m512i mantissa = _mm512_set1_epi32((1 << 24) - 1);
+			const __m512 scale = _mm512_set1_ps(1.f / (1 << 24));
+			__m512i position = _mm512_add_epi32(_mm512_set1_epi32(int(counter0)),
+				_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				__m512i m = _mm512_mullo_epi32(position, _mm512_set1_epi32(int(0xB5297A4D)));
+				m = _mm512_add_epi32(m, seed);
+				m = _mm512_xor_si512(m, _mm512_srai_epi32(m, 8));
+				m = _mm512_mullo_epi32(m, _mm512_set1_epi32(int(0x68E31DA4)));
+				m = _mm512_xor_si512(m, _mm512_slli_epi32(m, 8));
+				m = _mm512_mullo_epi32(m, _mm512_set1_epi32(int(0x1B56C4E9)));
+				m = _mm512_xor_si512(m, _mm512_srai_epi32(m, 8));
+				_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(m, mantissa)), scale));
+				position = _mm512_add_epi32(position, _mm512_set1_epi32(16));
+			}
+			uniformScalar(key, counter0 + uint32_t(i), out + i, n - i);
+		}
+	}
+
+	inline void RandomStream::fillUniform(float* out, size_t n)
+	{
+		static const detail::RandomFillKernel kernel = pickKernel<detail::RandomFillKernel>(
+			detail::uniformScalar, nullptr, detail::uniformAvx2, detail::uniformAvx512);
+		kernel(m_key, m_counter, out, n);
+		m_counter += uint32_t(n);
+	}
+
+	inline void RandomStream::fillNormal(float* out, size_t n)
+	{
+		static const detail::RandomFillKernel kernel = pickKernel<detail::RandomFillKernel>(
+			detail::normalScalar, nullptr, detail::normalAvx2);
+		kernel(m_key, m_counter, out, n);
+		m_counter += uint32_t(n);
+	}
+
+	inline void RandomStream::fillUnitVectors(float* x, float* y, float* z, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			const Vec3f v = unitVector();
+			x[i] = v.x();
+			y[i] = v.y();
+			z[i] = v.z();
+		}
+	}
+}	// namespace math
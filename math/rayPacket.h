@@ -0,0 +1,238 @@
+#pragma once
+// Ray packet kernels: 4 or 8 rays against one box, and one ray against 4 or 8 boxes.
+// Rays and boxes are stored as structure of arrays, one lane per ray or box. Each ray lane carries
+// its own [tMin, tMax] interval, which closest hit queries shrink as they find hits.
+// Every test returns a bit mask of the lanes hit, and the entry distance of each lane. The distances
+// of lanes not hit are meaningless, but always written.
+// Inactive lanes are masked out, and a test returns early when no lane survives the x and y slabs.
+//
+// Slabs follow AABB::intersect, including the operand order of min and max: a ray parallel to a
+// slab, with its origin on the slab plane, produces a NaN that is discarded instead of a hit.
+// The 8 lane versions need AVX2. Like float8, only call them after checking simdLevel().
+
+#include "aabb.h"
+#include "ray.h"
+#include "simd.h"
+#include "vectorFloat.h"
+
+namespace math
+{
+	//---------------------------------------------------------------------------------------------
+	// 4 rays in implicit form
+	struct RayPacket4
+	{
+		float4 ox, oy, oz; // Origin
+		float4 nx, ny, nz; // 1 / direction
+		float4 tMin, tMax;
+
+		RayPacket4() = default;
+
+		// Lanes past count repeat the last ray
+		RayPacket4(const Ray* rays, int count, float _tMin, float _tMax)
+			: tMin(_tMin), tMax(_tMax)
+		{
+			alignas(16) float o[3][4], n[3][4];
+			for (int i = 0; i < 4; ++i)
+			{
+				const Ray::Implicit r = rays[i < count ? i : count - 1].implicit();
+				for (int c = 0; c < 3; ++c)
+				{
+					o[c][i] = r.o[c];
+					n[c][i] = r.n[c];
+				}
+			}
+			ox = float4(_mm_load_ps(o[0])); oy = float4(_mm_load_ps(o[1])); oz = float4(_mm_load_ps(o[2]));
+			nx = float4(_mm_load_ps(n[0])); ny = float4(_mm_load_ps(n[1])); nz = float4(_mm_load_ps(n[2]));
+		}
+
+		// Closest hit tracking: lanes in mask end at t
+		void shrink(int mask, const float4& t)
+		{
+			tMax = select(laneMask(mask), t, tMax);
+		}
+
+		static float4 laneMask(int mask)
+		{
+			return float4(_mm_castsi128_ps(_mm_set_epi32(
+				mask & 8 ? -1 : 0, mask & 4 ? -1 : 0, mask & 2 ? -1 : 0, mask & 1 ? -1 : 0)));
+		}
+	};
+
+	// 4 boxes, one lane each
+	struct AABB4
+	{
+		float4 minX, minY, minZ;
+		float4 maxX, maxY, maxZ;
+
+		AABB4() = default;
+
+		// Lanes past count hold empty boxes, that no ray hits
+		AABB4(const AABB* boxes, int count)
+		{
+			alignas(16) float lo[3][4], hi[3][4];
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					lo[c][i] = i < count ? boxes[i].min()[c] : std::numeric_limits<float>::infinity();
+					hi[c][i] = i < count ? boxes[i].max()[c] : -std::numeric_limits<float>::infinity();
+				}
+			}
+			minX = float4(_mm_load_ps(lo[0])); minY = float4(_mm_load_ps(lo[1])); minZ = float4(_mm_load_ps(lo[2]));
+			maxX = float4(_mm_load_ps(hi[0])); maxY = float4(_mm_load_ps(hi[1])); maxZ = float4(_mm_load_ps(hi[2]));
+		}
+	};
+
+	// Rays of the packet, among activeMask, that hit the box within their [tMin, tMax]
+	inline int intersect(const RayPacket4& rays, const AABB& box, float4& tEnter, int activeMask = 0xf)
+	{
+		if (!activeMask)
+			return 0;
+		const float4 t1x = (float4(box.min().x()) - rays.ox) * rays.nx, t2x = (float4(box.max().x()) - rays.ox) * rays.nx;
+		const float4 t1y = (float4(box.min().y()) - rays.oy) * rays.ny, t2y = (float4(box.max().y()) - rays.oy) * rays.ny;
+		float4 enter = math::max(math::max(math::min(t1x, t2x), math::min(t1y, t2y)), rays.tMin);
+		float4 leave = math::min(math::min(math::max(t2x, t1x), math::max(t2y, t1y)), rays.tMax);
+		tEnter = enter;
+		if (!((enter <= leave).mask() & activeMask))
+			return 0;
+
+		const float4 t1z = (float4(box.min().z()) - rays.oz) * rays.nz, t2z = (float4(box.max().z()) - rays.oz) * rays.nz;
+		enter = math::max(math::min(t1z, t2z), enter);
+		leave = math::min(math::max(t2z, t1z), leave);
+		tEnter = enter;
+		return (enter <= leave).mask() & activeMask;
+	}
+
+	// Boxes, among activeMask, hit by the ray within [tMin, tMax]
+	inline int intersect(const Ray::Implicit& ray, float tMin, float tMax, const AABB4& boxes, float4& tEnter, int activeMask = 0xf)
+	{
+		if (!activeMask)
+			return 0;
+		const float4 ox(ray.o.x()), oy(ray.o.y()), oz(ray.o.z());
+		const float4 nx(ray.n.x()), ny(ray.n.y()), nz(ray.n.z());
+		const float4 t1x = (boxes.minX - ox) * nx, t2x = (boxes.maxX - ox) * nx;
+		const float4 t1y = (boxes.minY - oy) * ny, t2y = (boxes.maxY - oy) * ny;
+		float4 enter = math::max(math::max(math::min(t1x, t2x), math::min(t1y, t2y)), float4(tMin));
+		float4 leave = math::min(math::min(math::max(t2x, t1x), math::max(t2y, t1y)), float4(tMax));
+		tEnter = enter;
+		if (!((enter <= leave).mask() & activeMask))
+			return 0;
+
+		const float4 t1z = (boxes.minZ - oz) * nz, t2z = (boxes.maxZ - oz) * nz;
+		enter = math::max(math::min(t1z, t2z), enter);
+		leave = math::min(math::max(t2z, t1z), leave);
+		tEnter = enter;
+		return (enter <= leave).mask() & activeMask;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	MATH_AVX2_BEGIN
+
+	// 8 rays in implicit form
+	struct RayPacket8
+	{
+		float8 ox, oy, oz; // Origin
+		float8 nx, ny, nz; // 1 / direction
+		float8 tMin, tMax;
+
+		RayPacket8() = default;
+
+		// Lanes past count repeat the last ray
+		RayPacket8(const Ray* rays, int count, float _tMin, float _tMax)
+			: tMin(_tMin), tMax(_tMax)
+		{
+			alignas(32) float o[3][8], n[3][8];
+			for (int i = 0; i < 8; ++i)
+			{
+				const Ray::Implicit r = rays[i < count ? i : count - 1].implicit();
+				for (int c = 0; c < 3; ++c)
+				{
+					o[c][i] = r.o[c];
+					n[c][i] = r.n[c];
+				}
+			}
+			ox = float8::load(o[0]); oy = float8::load(o[1]); oz = float8::load(o[2]);
+			nx = float8::load(n[0]); ny = float8::load(n[1]); nz = float8::load(n[2]);
+		}
+
+		// Closest hit tracking: lanes in mask end at t
+		void shrink(int mask, const float8& t)
+		{
+			tMax = select(laneMask(mask), t, tMax);
+		}
+
+		static mask8 laneMask(int mask)
+		{
+			const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			const __m256i m = _mm256_and_si256(_mm256_set1_epi32(mask), bits);
+			return mask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(m, bits)));
+		}
+	};
+
+	// 8 boxes, one lane each
+	struct AABB8
+	{
+		float8 minX, minY, minZ;
+		float8 maxX, maxY, maxZ;
+
+		AABB8() = default;
+
+		// Lanes past count hold empty boxes, that no ray hits
+		AABB8(const AABB* boxes, int count)
+		{
+			alignas(32) float lo[3][8], hi[3][8];
+			for (int i = 0; i < 8; ++i)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					lo[c][i] = i < count ? boxes[i].min()[c] : std::numeric_limits<float>::infinity();
+					hi[c][i] = i < count ? boxes[i].max()[c] : -std::numeric_limits<float>::infinity();
+				}
+			}
+			minX = float8::load(lo[0]); minY = float8::load(lo[1]); minZ = float8::load(lo[2]);
+			maxX = float8::load(hi[0]); maxY = float8::load(hi[1]); maxZ = float8::load(hi[2]);
+		}
+	};
+
+	inline int intersect(const RayPacket8& rays, const AABB& box, float8& tEnter, int activeMask = 0xff)
+	{
+		if (!activeMask)
+			return 0;
+		const float8 t1x = (float8(box.min().x()) - rays.ox) * rays.nx, t2x = (float8(box.max().x()) - rays.ox) * rays.nx;
+		const float8 t1y = (float8(box.min().y()) - rays.oy) * rays.ny, t2y = (float8(box.max().y()) - rays.oy) * rays.ny;
+		float8 enter = max(max(min(t1x, t2x), min(t1y, t2y)), rays.tMin);
+		float8 leave = min(min(max(t2x, t1x), max(t2y, t1y)), rays.tMax);
+		tEnter = enter;
+		if (!((enter <= leave).mask() & activeMask))
+			return 0;
+
+		const float8 t1z = (float8(box.min().z()) - rays.oz) * rays.nz, t2z = (float8(box.max().z()) - rays.oz) * rays.nz;
+		enter = max(min(t1z, t2z), enter);
+		leave = min(max(t2z, t1z), leave);
+		tEnter = enter;
+		return (enter <= leave).mask() & activeMask;
+	}
+
+	inline int intersect(const Ray::Implicit& ray, float tMin, float tMax, const AABB8& boxes, float8& tEnter, int activeMask = 0xff)
+	{
+		if (!activeMask)
+			return 0;
+		const float8 ox(ray.o.x()), oy(ray.o.y()), oz(ray.o.z());
+		const float8 nx(ray.n.x()), ny(ray.n.y()), nz(ray.n.z());
+		const float8 t1x = (boxes.minX - ox) * nx, t2x = (boxes.maxX - ox) * nx;
+		const float8 t1y = (boxes.minY - oy) * ny, t2y = (boxes.maxY - oy) * ny;
+		float8 enter = max(max(min(t1x, t2x), min(t1y, t2y)), float8(tMin));
+		float8 leave = min(min(max(t2x, t1x), max(t2y, t1y)), float8(tMax));
+		tEnter = enter;
+		if (!((enter <= leave).mask() & activeMask))
+			return 0;
+
+		const float8 t1z = (boxes.minZ - oz) * nz, t2z = (boxes.maxZ - oz) * nz;
+		enter = max(min(t1z, t2z), enter);
+		leave = min(max(t2z, t1z), leave);
+		tEnter = enter;
+		return (enter <= leave).mask() & activeMask;
+	}
+
+	MATH_AVX2_END
+}	// namespace math
@@ -0,0 +1,130 @@
+#pragma once
+// Instruction set detection and per function target selection.
+// Lets one binary carry SSE2, AVX2 and AVX-512 versions of a hot kernel and pick the best one the
+// running CPU supports. x86-64 guarantees SSE2, so float4 code needs no dispatch. Wider kernels are
+// compiled with MATH_TARGET_AVX2 / MATH_TARGET_AVX512 and selected once through pickKernel.
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Compile one function for an instruction set the rest of the translation unit doesn't assume.
+// MSVC allows any intrinsic in any function, so there it expands to nothing.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MATH_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx512vl,avx2,fma")))
+#else
+#define MATH_TARGET_AVX2
+#define MATH_TARGET_AVX512
+#endif
+
+// Same as MATH_TARGET_AVX2, for every function between BEGIN and END
+#if defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define MATH_AVX2_BEGIN _Pragma("clang attribute push(__attribute__((target(\"avx2,fma\"))), apply_to = function)")
+#define MATH_AVX2_END _Pragma("clang attribute pop")
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATH_AVX2_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define MATH_AVX2_END _Pragma("GCC pop_options")
+#else
+#define MATH_AVX2_BEGIN
+#define MATH_AVX2_END
+#endif
+
+namespace math
+{
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE2,
+		AVX2, // Includes FMA
+		AVX512 // F, DQ and VL
+	};
+
+	inline const char* simdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE2: return "sse2";
+		case SimdLevel::AVX2: return "avx2";
+		case SimdLevel::AVX512: return "avx512";
+		default: return "scalar";
+		}
+	}
+
+	// Best instruction set supported by both the CPU and the OS
+	inline SimdLevel detectSimdLevel()
+	{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+			return SimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return SimdLevel::SSE2;
+		return SimdLevel::Scalar;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool sse2 = (info[3] >> 26) & 1;
+		const bool fma = (info[2] >> 12) & 1;
+		const bool osxsave = (info[2] >> 27) & 1;
+		const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		const bool osYmm = (xcr0 & 0x6) == 0x6;
+		const bool osZmm = (xcr0 & 0xe6) == 0xe6;
+		bool avx2 = false, avx512 = false;
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] >> 5) & 1;
+			avx512 = ((info[1] >> 16) & 1) && ((info[1] >> 17) & 1) && ((info[1] >> 31) & 1); // F, DQ, VL
+		}
+		if (avx512 && avx2 && fma && osZmm)
+			return SimdLevel::AVX512;
+		if (avx2 && fma && osYmm)
+			return SimdLevel::AVX2;
+		return sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	// Level used for dispatch. Detected once, and can be capped with the MATH_SIMD environment
+	// variable (scalar, sse2, avx2 or avx512) to test or benchmark the narrower paths.
+	inline SimdLevel simdLevel()
+	{
+		static const SimdLevel level = [] {
+			SimdLevel detected = detectSimdLevel();
+			if (const char* cap = std::getenv("MATH_SIMD"))
+			{
+				for (SimdLevel l : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+				{
+					if (std::strcmp(cap, simdLevelName(l)) == 0 && l < detected)
+						return l;
+				}
+			}
+			return detected;
+		}();
+		return level;
+	}
+
+	// Widest available implementation of a kernel. Any of the SIMD versions may be null.
+	template<class Fn>
+	Fn pickKernel(Fn scalar, Fn sse2, Fn avx2 = nullptr, Fn avx512 = nullptr)
+	{
+		const SimdLevel level = simdLevel();
+		if (avx512 && level >= SimdLevel::AVX512)
+			return avx512;
+		if (avx2 && level >= SimdLevel::AVX2)
+			return avx2;
+		if (sse2 && level >= SimdLevel::SSE2)
+			return sse2;
+		return scalar;
+	}
+}	// namespace math
@@ -18,66 +18,174 @@
 // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #pragma once
+// Real spherical harmonics, with the Condon-Shortley phase.
+// Coefficients are stored band after band: index l*(l+1)+m, for -l <= m <= l.
+// Associated Legendre polynomials are evaluated with the usual recurrences in l and m, with the
+// sin(theta)^m factor folded into cos(m*phi) and sin(m*phi), so everything is a polynomial in x, y, z.
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include "constants.h"
+#include "vector.h"
+#include "vectorFloat.h"
 
 namespace math {
 
-	int factorial(int x)
+	constexpr int shIndex(int l, int m) { return l*(l+1) + m; }
+	// Number of coefficients in bands 0 to L
+	constexpr int shCount(int L) { return (L+1)*(L+1); }
+
+	constexpr double factorial(int x)
 	{
-		if(x <= 1)
-			return 1;
-		return x*factorial(x-1);
+		double f = 1;
+		for(int i = 2; i <= x; ++i)
+			f *= i;
+		return f;
 	}
 
-	float shNorm(int l, int m)
+	constexpr float shNorm(int l, int m)
 	{
-		auto num = (2*l+1)*factorial(l-abs(m));
-		auto den = 4*math::Constants<float>::pi*factorial(l+abs(m));
-		return sqrt(num/den);
+		const int am = m < 0 ? -m : m;
+		const double num = (2*l+1)*factorial(l-am);
+		const double den = 4*Constants<double>::pi*factorial(l+am);
+		return float(detail::constexprSqrt(num/den));
 	}
 
-	float legendre(int l, int m, float sinTheta, float z)
+	// Normalization factors for bands 0 to L, including the sqrt(2) of the m != 0 terms
+	template<int L>
+	constexpr std::array<float, shCount(L)> shNormTable()
 	{
-		assert(m <= l);
-		if(m == 0 && l == 0)
+		std::array<float, shCount(L)> k{};
+		for(int l = 0; l <= L; ++l)
+			for(int m = -l; m <= l; ++m)
+				k[shIndex(l,m)] = float((m == 0 ? 1.0 : detail::constexprSqrt(2.0)) * shNorm(l,m));
+		return k;
+	}
+
+	// Associated Legendre polynomial P_l^m(z), with z = cos(theta), 0 <= m <= l
+	inline float legendre(int l, int m, float sinTheta, float z)
+	{
+		assert(m >= 0 && m <= l);
+		// P_m^m = (1-2m) sinTheta P_m-1^m-1
+		float pmm = 1.f;
+		for(int i = 1; i <= m; ++i)
+			pmm *= (1-2*i) * sinTheta;
+		if(l == m)
+			return pmm;
+		// P_m+1^m = (2m+1) z P_m^m
+		float pl1 = (2*m+1) * z * pmm;
+		float pl2 = pmm;
+		// (l-m) P_l^m = (2l-1) z P_l-1^m - (l+m-1) P_l-2^m
+		for(int i = m+2; i <= l; ++i)
 		{
-			return 1.f;
+			float pl = ((2*i-1) * z * pl1 - (i+m-1) * pl2) / (i-m);
+			pl2 = pl1;
+			pl1 = pl;
+		}
+		return pl1;
+	}
+
+	//--------------------------------------------------------------------------------------------------
+	inline float sh(int l, int m, float cosTheta, float phi)
+	{
+		float sinTheta = std::sqrt(std::max(0.f, 1-cosTheta*cosTheta));
+		if(m > 0)
+		{
+			return std::sqrt(2.f)*shNorm(l,m)*std::cos(m*phi)*legendre(l,m,sinTheta,cosTheta);
+		}else if(m < 0)
+		{
+			return std::sqrt(2.f)*shNorm(l,m)*std::sin(-m*phi)*legendre(l,-m,sinTheta,cosTheta);
 		}
 		else
+			return shNorm(l,0)*legendre(l,0,sinTheta,cosTheta);
+	}
+
+	//--------------------------------------------------------------------------------------------------
+	// All coefficients of bands 0 to L for the unit direction (x,y,z), in one pass.
+	// T can be float, or float4 to evaluate 4 directions at once.
+	template<int L, class T>
+	void shEvaluate(const T& x, const T& y, const T& z, T* out)
+	{
+		static constexpr auto k = shNormTable<L>();
+
+		// c = sinTheta^m cos(m phi), s = sinTheta^m sin(m phi), built as powers of (x + iy)
+		T c = T(1.f), s = T(0.f);
+		// Q = P_m^m / sinTheta^m = (-1)^m (2m-1)!!
+		float q = 1.f;
+		for(int m = 0; m <= L; ++m)
 		{
-			float zp = z*pow(sinTheta,m);
-			if(m == l)
-			{
-				return (1-2*m)*legendre(l-1,m-1,sinTheta,z);
-			}
-			else if(l == m+1)
+			// Q_l^m for l = m, m+1, ...
+			T pl2 = T(q);
+			T pl1 = T(float(2*m+1) * q) * z;
+			for(int l = m; l <= L; ++l)
 			{
-				return (2*m+1)*zp*legendre(m,m,sinTheta, z);
-			} else
-			{
-				auto num = (2*l-1)*zp*legendre(l-1,m,sinTheta, z) - (l+m-1)*legendre(l-2,m,sinTheta,z);
-				auto den = l-m;
-				return num/den;
+				T p;
+				if(l == m)
+					p = pl2;
+				else if(l == m+1)
+					p = pl1;
+				else
+				{
+					p = (T(float(2*l-1) / (l-m)) * z * pl1 - T(float(l+m-1) / (l-m)) * pl2);
+					pl2 = pl1;
+					pl1 = p;
+				}
+				if(m == 0)
+					out[shIndex(l,0)] = T(k[shIndex(l,0)]) * p;
+				else
+				{
+					out[shIndex(l,m)] = T(k[shIndex(l,m)]) * p * c;
+					out[shIndex(l,-m)] = T(k[shIndex(l,-m)]) * p * s;
+				}
 			}
+
+			// Next m
+			T cNext = x * c - y * s;
+			s = x * s + y * c;
+			c = cNext;
+			q *= float(-(2*m+1));
 		}
 	}
 
+	template<int L>
+	void shEvaluate(const Vec3f& dir, float* out)
+	{
+		shEvaluate<L, float>(dir.x(), dir.y(), dir.z(), out);
+	}
+
 	//--------------------------------------------------------------------------------------------------
-	float sh(int l, int m, float cosTheta, float phi)
+	// Adds weight * value[i] * Y(dir[i]) to coeffs, for count unit directions in SoA form.
+	// For uniformly distributed directions, weight = 4*pi/count gives the projection of value onto bands 0 to L.
+	template<int L>
+	void shProject(const float* x, const float* y, const float* z, const float* values, size_t count, float weight, float* coeffs)
 	{
-		float sinTheta = sqrt(1-cosTheta*cosTheta);
-		if(m > 0)
+		constexpr int n = shCount(L);
+		float4 accum[n];
+		for(int i = 0; i < n; ++i)
+			accum[i] = float4(0.f);
+
+		float4 basis[n];
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4)
 		{
-			return sqrt(2.f)*shNorm(l,m)*cos(m*phi)*legendre(l,m,sinTheta,cosTheta);
-		}else if(m < 0)
+			shEvaluate<L, float4>(float4(_mm_loadu_ps(x+i)), float4(_mm_loadu_ps(y+i)), float4(_mm_loadu_ps(z+i)), basis);
+			const float4 v(_mm_loadu_ps(values+i));
+			for(int j = 0; j < n; ++j)
+				accum[j] += basis[j] * v;
+		}
+		for(int j = 0; j < n; ++j)
+			coeffs[j] += weight * (accum[j].x() + accum[j].y() + accum[j].z() + accum[j].w());
+
+		float scalarBasis[n];
+		for(; i < count; ++i)
 		{
-			return sqrt(2.f)*shNorm(l,m)*sin(abs(m)*phi)*legendre(l,abs(m),sinTheta,cosTheta);
+			shEvaluate<L, float>(x[i], y[i], z[i], scalarBasis);
+			for(int j = 0; j < n; ++j)
+				coeffs[j] += weight * values[i] * scalarBasis[j];
 		}
-		else
-			return shNorm(l,0)*legendre(l,0,sinTheta,cosTheta);
 	}
 
 	// Spherical harmonics coefficients
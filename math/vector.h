@@ -22,16 +22,92 @@
 #include <cmath>
 #ifndef AVR
 #include <initializer_list>
+#include <type_traits>
 #endif // AVR
 
 #ifdef AVR
 #define FORCE_INLINE inline
-#else
+#elif defined(_MSC_VER)
 #define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+// SIMD backed Vec4f, Vec2d and Vec4d. AVR and other targets fall back to the scalar templates.
+#if !defined(AVR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATH_VECTOR_SSE
+#include <immintrin.h>
+#endif
+#if defined(MATH_VECTOR_SSE) && defined(__AVX__)
+#define MATH_VECTOR_AVX
+#endif
+
+// Whether constant evaluation can be told apart from run time. Needed for the SIMD overloads and
+// norm() to be usable in constant expressions, since those fall back to scalar code there.
+#if defined(__cpp_lib_is_constant_evaluated)
+#define MATH_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(__GNUC__) && __GNUC__ >= 9
+#define MATH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#elif defined(__clang__) && defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define MATH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+
+#ifdef MATH_CONSTANT_EVALUATED
+#define MATH_SIMD_CONSTEXPR constexpr
+#else
+#define MATH_CONSTANT_EVALUATED() false
+#define MATH_SIMD_CONSTEXPR
 #endif
 
 namespace math
 {
+	namespace detail
+	{
+		// Newton iterations, for square roots in constant expressions
+		constexpr double constexprSqrt(double x)
+		{
+			if(x <= 0)
+				return 0;
+			double r = x > 1 ? x : 1;
+			for(int i = 0; i < 64; ++i)
+				r = 0.5 * (r + x / r);
+			return r;
+		}
+
+		template<class T>
+		constexpr T sqrt(T x)
+		{
+			if(MATH_CONSTANT_EVALUATED())
+				return T(constexprSqrt(double(x)));
+			return std::sqrt(x);
+		}
+
+		// Unlike std::abs, returns -0 for -0 during constant evaluation
+		template<class T>
+		constexpr T abs(T x)
+		{
+			if(MATH_CONSTANT_EVALUATED())
+				return x < T(0) ? -x : x;
+			return std::abs(x);
+		}
+
+		// Scalar operand of the vector/scalar operators: double for Vector<double>, float otherwise.
+		// Not deducible, so integer literals still convert. Hand written, since AVR has no <type_traits>.
+		template<class T> struct ScalarOf { using type = float; };
+		template<> struct ScalarOf<double> { using type = double; };
+		template<class T>
+		using Scalar = typename ScalarOf<T>::type;
+	}
+
+	// Storage alignment, so SIMD sized vectors can use aligned loads.
+	// Vec3f stays packed: Matrix34f aliases its columns as Vec3f.
+	template<class T, int n> struct VectorAlignment { static constexpr size_t value = alignof(T); };
+	template<> struct VectorAlignment<float, 4> { static constexpr size_t value = 16; };
+	template<> struct VectorAlignment<double, 2> { static constexpr size_t value = 16; };
+	template<> struct VectorAlignment<double, 4> { static constexpr size_t value = 32; };
+
 	template<class T, int n>
 	struct Vector
 	{
@@ -39,13 +115,16 @@ namespace math
 		Vector() = default;
 
 #ifndef AVR
-		Vector(std::initializer_list<T> il)
+		constexpr Vector(std::initializer_list<T> il)
+			: m{}
 		{
 			auto iter = il.begin();
 			for(size_t i = 0; i < n; ++i)
 				m[i] = *iter++;
 		}
-		constexpr Vector(T t) {
+		constexpr Vector(T t)
+			: m{}
+		{
 			for(auto i = 0; i < n; ++i)
 				m[i] = t;
 		}
@@ -60,7 +139,7 @@ namespace math
 			return *this;
 		}*/
 
-		Vector& operator=(const Vector& v) = default;
+		constexpr Vector& operator=(const Vector& v) = default;
 		/*Vector& operator=(const std::array<T, n>& v) {
 			for(auto i = 0; i < n; ++i)
 				m[i] = v[i];
@@ -68,65 +147,74 @@ namespace math
 		}*/
 
 		// Vector accessors
-		T x() const { return m[0]; }
-		T y() const { return m[1]; static_assert(n>0); }
-		T z() const { return m[2]; static_assert(n>1); }
-		T w() const { return m[2]; static_assert(n>2); }
-		T& x() { return m[0]; }
-		T& y() { return m[1]; static_assert(n>0); }
-		T& z() { return m[2]; static_assert(n>1); }
-		T& w() { return m[2]; static_assert(n>2); }
+		constexpr T x() const { return m[0]; }
+		constexpr T y() const { return m[1]; static_assert(n>1); }
+		constexpr T z() const { return m[2]; static_assert(n>2); }
+		constexpr T w() const { return m[3]; static_assert(n>3); }
+		constexpr T& x() { return m[0]; }
+		constexpr T& y() { return m[1]; static_assert(n>1); }
+		constexpr T& z() { return m[2]; static_assert(n>2); }
+		constexpr T& w() { return m[3]; static_assert(n>3); }
 
 		// Indexed accessor
 		constexpr T operator[](size_t i) const { return m[i]; }
-		T& operator[](size_t i) { return m[i]; }
+		constexpr T& operator[](size_t i) { return m[i]; }
+
+		// Raw access
+		constexpr const T* data() const { return m; }
+		constexpr T* data() { return m; }
 
 		// Basic properties
-		constexpr T norm() const { return std::sqrt(sqNorm()); }
+		constexpr T norm() const { return detail::sqrt(sqNorm()); }
 		constexpr T sqNorm() const;
 
 		// Math operators
-		Vector operator-() const { return {-x(), -y(), -z()}; }
-		Vector& operator+=(const Vector& v) {
+		constexpr Vector operator-() const {
+			Vector res{};
+			for(size_t i = 0; i < n; ++i)
+				res.m[i] = -m[i];
+			return res;
+		}
+		constexpr Vector& operator+=(const Vector& v) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] += v.m[i];
 			return *this;
 		}
 
-		Vector& operator-=(const Vector& v) {
+		constexpr Vector& operator-=(const Vector& v) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] -= v.m[i];
 			return *this;
 		}
 
-		Vector& operator*=(const Vector& v) {
+		constexpr Vector& operator*=(const Vector& v) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] *= v.m[i];
 			return *this;
 		}
 
-		Vector& operator/=(const Vector& v) {
+		constexpr Vector& operator/=(const Vector& v) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] /= v.m[i];
 			return *this;
 		}
 
 		template<class T2>
-		Vector& operator*=(T2 t) {
+		constexpr Vector& operator*=(T2 t) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] *= T(t);
 			return *this;
 		}
 
 		template<class T2>
-		Vector& operator/=(T2 t) {
+		constexpr Vector& operator/=(T2 t) {
 			for(size_t i = 0; i < n; ++i)
 				m[i] /= T(t);
 			return *this;
 		}
 
 	private:
-		T m[n];
+		alignas(VectorAlignment<T, n>::value) T m[n];
 	};
 
 	//---------------------------------------------------------------------------------------------
@@ -153,115 +241,115 @@ namespace math
 	// External operators
 	//---------------------------------------------------------------------------------------------
 	template<class T, int n>
-	Vector<T,n> operator+(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr Vector<T,n> operator+(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] + b[i];
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator-(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr Vector<T,n> operator-(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] - b[i];
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator*(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr Vector<T,n> operator*(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] * b[i];
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator/(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr Vector<T,n> operator/(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] / b[i];
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator+(const Vector<T,n>& a, float b)
+	constexpr Vector<T,n> operator+(const Vector<T,n>& a, detail::Scalar<T> b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] + b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator-(const Vector<T,n>& a, float b)
+	constexpr Vector<T,n> operator-(const Vector<T,n>& a, detail::Scalar<T> b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] - b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator+(float b, const Vector<T,n>& a)
+	constexpr Vector<T,n> operator+(detail::Scalar<T> b, const Vector<T,n>& a)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] + b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator-(float b, const Vector<T,n>& a)
+	constexpr Vector<T,n> operator-(detail::Scalar<T> b, const Vector<T,n>& a)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] - b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator*(const Vector<T,n>& a, float b)
+	constexpr Vector<T,n> operator*(const Vector<T,n>& a, detail::Scalar<T> b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] * b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator/(const Vector<T,n>& a, float b)
+	constexpr Vector<T,n> operator/(const Vector<T,n>& a, detail::Scalar<T> b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] / b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator*(float b, const Vector<T,n>& a)
+	constexpr Vector<T,n> operator*(detail::Scalar<T> b, const Vector<T,n>& a)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] * b;
 		return res;
 	}
 
 	template<class T, int n>
-	Vector<T,n> operator/(float b, const Vector<T,n>& a)
+	constexpr Vector<T,n> operator/(detail::Scalar<T> b, const Vector<T,n>& a)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
 			res[i] = a[i] / b;
 		return res;
 	}
 
 	template<class T, int n>
-	bool operator==(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr bool operator==(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
 		for(int i = 0; i < n; ++i)
 			if(!(a[i] == b[i]))
@@ -270,7 +358,7 @@ namespace math
 	}
 
 	template<class T> // Dot product short-hand
-	T operator*(const Vector2<T>& a, const Vector2<T>& b)
+	constexpr T operator*(const Vector2<T>& a, const Vector2<T>& b)
 	{
 		return a[0] * b[0] + a[1] * b[1];
 	}
@@ -278,7 +366,7 @@ namespace math
 	//---------------------------------------------------------------------------------------------
 	// Inline methods
 	//---------------------------------------------------------------------------------------------
-	template<class T, int n> auto dot(const Vector<T,n>& a, const Vector<T,n>& b) -> T
+	template<class T, int n> constexpr auto dot(const Vector<T,n>& a, const Vector<T,n>& b) -> T
 	{
 		auto d = T(0);
 		for(int i = 0; i < n; ++i)
@@ -287,7 +375,7 @@ namespace math
 	}
 
 	template<class T>
-	Vector<T,3> cross(const Vector<T,3>& a, const Vector<T,3>& b)
+	constexpr Vector<T,3> cross(const Vector<T,3>& a, const Vector<T,3>& b)
 	{
 		return {
 			a.y()*b.z()-a.z()*b.y(),
@@ -297,36 +385,36 @@ namespace math
 	}
 
 	template<class T, int n>
-	auto reflect(const Vector<T,n>& v, const Vector<T,n>& normal) -> Vector<T,n>
+	constexpr auto reflect(const Vector<T,n>& v, const Vector<T,n>& normal) -> Vector<T,n>
 	{
 		return v - 2 * dot(v, normal) * normal;
 	}
 
 #ifndef AVR
 	template<class T, int n>
-	auto min(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr auto min(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
-			res[i] = std::min(a[i], b[i]);
+			res[i] = b[i] < a[i] ? b[i] : a[i];
 		return res;
 	}
 
 	template<class T, int n>
-	auto max(const Vector<T,n>& a, const Vector<T,n>& b)
+	constexpr auto max(const Vector<T,n>& a, const Vector<T,n>& b)
 	{
-		Vector<T,n> res;
+		Vector<T,n> res{};
 		for(int i = 0; i < n; ++i)
-			res[i] = std::max(a[i], b[i]);
+			res[i] = a[i] < b[i] ? b[i] : a[i];
 		return res;
 	}
 
     template<class T, int n>
-    auto abs(const Vector<T, n>& a)
+    constexpr auto abs(const Vector<T, n>& a)
     {
-        Vector<T, n> res;
+        Vector<T, n> res{};
         for (int i = 0; i < n; ++i)
-            res[i] = std::abs(a[i]);
+            res[i] = detail::abs(a[i]);
         return res;
     }
 #endif // AVR
@@ -336,36 +424,341 @@ namespace math
 		return dot(*this, *this);
 	}
 
-	template<class T, int n> auto normalize(const Vector<T,n>& v) -> Vector<T,n>
+	template<class T, int n> constexpr auto normalize(const Vector<T,n>& v) -> Vector<T,n>
 	{
 		return v * (1/v.norm());
 	}
 
 	// Vec3f specializations
-	FORCE_INLINE Vector<float, 3> operator+(const Vector<float, 3>& a, const Vector<float, 3>& b)
+	FORCE_INLINE constexpr Vector<float, 3> operator+(const Vector<float, 3>& a, const Vector<float, 3>& b)
 	{
 		return Vector<float, 3>(a.x() + b.x(), a.y() + b.y(), a.z() + b.z());
 	}
 
-	FORCE_INLINE Vector<float, 3> operator-(const Vector<float, 3>& a, const Vector<float, 3>& b)
+	FORCE_INLINE constexpr Vector<float, 3> operator-(const Vector<float, 3>& a, const Vector<float, 3>& b)
 	{
 		return Vector<float, 3>(a.x() - b.x(), a.y() - b.y(), a.z() - b.z());
 	}
 
-	FORCE_INLINE Vector<float, 3> operator*(const Vector<float, 3>& a, const Vector<float, 3>& b)
+	FORCE_INLINE constexpr Vector<float, 3> operator*(const Vector<float, 3>& a, const Vector<float, 3>& b)
 	{
 		return Vector<float, 3>(a.x() * b.x(), a.y() * b.y(), a.z() * b.z());
 	}
 
-	FORCE_INLINE Vector<float, 3> operator*(const Vector<float, 3>& a, float b)
+	FORCE_INLINE constexpr Vector<float, 3> operator*(const Vector<float, 3>& a, float b)
 	{
 		return Vector<float, 3>(a.x() * b, a.y() * b, a.z() * b);
 	}
 
-	FORCE_INLINE Vector<float, 3> operator/(const Vector<float, 3>& a, float b)
+	FORCE_INLINE constexpr Vector<float, 3> operator/(const Vector<float, 3>& a, float b)
 	{
 		auto rcp = 1.f / b;
 		return Vector<float, 3>(a.x() * rcp, a.y() * rcp, a.z() * rcp);
 	}
 
+#ifdef MATH_VECTOR_SSE
+	//---------------------------------------------------------------------------------------------
+	// SIMD specializations. During constant evaluation they run the scalar code in detail instead.
+	//---------------------------------------------------------------------------------------------
+	namespace detail
+	{
+		struct Add { template<class T> constexpr T operator()(T a, T b) const { return a + b; } };
+		struct Sub { template<class T> constexpr T operator()(T a, T b) const { return a - b; } };
+		struct Mul { template<class T> constexpr T operator()(T a, T b) const { return a * b; } };
+		struct Div { template<class T> constexpr T operator()(T a, T b) const { return a / b; } };
+		// Same operand order as minps and maxps
+		struct Min { template<class T> constexpr T operator()(T a, T b) const { return a < b ? a : b; } };
+		struct Max { template<class T> constexpr T operator()(T a, T b) const { return a > b ? a : b; } };
+
+		template<class T, int n, class Op>
+		constexpr Vector<T,n> elementWise(const Vector<T,n>& a, const Vector<T,n>& b, Op op)
+		{
+			Vector<T,n> res{};
+			for(int i = 0; i < n; ++i)
+				res[i] = op(a[i], b[i]);
+			return res;
+		}
+
+		template<class T, int n>
+		constexpr T dotScalar(const Vector<T,n>& a, const Vector<T,n>& b)
+		{
+			T d = T(0);
+			for(int i = 0; i < n; ++i)
+				d += a[i] * b[i];
+			return d;
+		}
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Vec4f specializations
+	//---------------------------------------------------------------------------------------------
+	namespace detail
+	{
+		FORCE_INLINE __m128 load(const Vec4f& v) { return _mm_load_ps(v.data()); }
+		FORCE_INLINE Vec4f toVec4f(__m128 m)
+		{
+			Vec4f res;
+			_mm_store_ps(res.data(), m);
+			return res;
+		}
+
+		// Sum of all lanes, broadcast to all lanes
+		FORCE_INLINE __m128 hsum(__m128 m)
+		{
+			__m128 t = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_add_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+		}
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator+(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Add());
+		return detail::toVec4f(_mm_add_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator-(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Sub());
+		return detail::toVec4f(_mm_sub_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator*(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Mul());
+		return detail::toVec4f(_mm_mul_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator/(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Div());
+		return detail::toVec4f(_mm_div_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator*(const Vec4f& a, float b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec4f(b), detail::Mul());
+		return detail::toVec4f(_mm_mul_ps(detail::load(a), _mm_set1_ps(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator*(float b, const Vec4f& a) { return a * b; }
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f operator/(const Vec4f& a, float b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec4f(b), detail::Div());
+		return detail::toVec4f(_mm_div_ps(detail::load(a), _mm_set1_ps(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR float dot(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::dotScalar(a, b);
+		return _mm_cvtss_f32(detail::hsum(_mm_mul_ps(detail::load(a), detail::load(b))));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f min(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Min());
+		return detail::toVec4f(_mm_min_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f max(const Vec4f& a, const Vec4f& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Max());
+		return detail::toVec4f(_mm_max_ps(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4f abs(const Vec4f& a)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return abs<float, 4>(a);
+		return detail::toVec4f(_mm_andnot_ps(_mm_set1_ps(-0.f), detail::load(a)));
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Vec2d specializations
+	// Note Vec2d * Vec2d is the dot product short-hand, so there's no element-wise operator*.
+	//---------------------------------------------------------------------------------------------
+	namespace detail
+	{
+		FORCE_INLINE __m128d load(const Vec2d& v) { return _mm_load_pd(v.data()); }
+		FORCE_INLINE Vec2d toVec2d(__m128d m)
+		{
+			Vec2d res;
+			_mm_store_pd(res.data(), m);
+			return res;
+		}
+
+		FORCE_INLINE double dot(__m128d a, __m128d b)
+		{
+			__m128d p = _mm_mul_pd(a, b);
+			return _mm_cvtsd_f64(_mm_add_sd(p, _mm_unpackhi_pd(p, p)));
+		}
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator+(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Add());
+		return detail::toVec2d(_mm_add_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator-(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Sub());
+		return detail::toVec2d(_mm_sub_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator/(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Div());
+		return detail::toVec2d(_mm_div_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator*(const Vec2d& a, double b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec2d(b), detail::Mul());
+		return detail::toVec2d(_mm_mul_pd(detail::load(a), _mm_set1_pd(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator*(double b, const Vec2d& a) { return a * b; }
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d operator/(const Vec2d& a, double b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec2d(b), detail::Div());
+		return detail::toVec2d(_mm_div_pd(detail::load(a), _mm_set1_pd(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR double dot(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::dotScalar(a, b);
+		return detail::dot(detail::load(a), detail::load(b));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d min(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Min());
+		return detail::toVec2d(_mm_min_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d max(const Vec2d& a, const Vec2d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Max());
+		return detail::toVec2d(_mm_max_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec2d abs(const Vec2d& a)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return abs<double, 2>(a);
+		return detail::toVec2d(_mm_andnot_pd(_mm_set1_pd(-0.0), detail::load(a)));
+	}
+
+#ifdef MATH_VECTOR_AVX
+	//---------------------------------------------------------------------------------------------
+	// Vec4d specializations
+	//---------------------------------------------------------------------------------------------
+	namespace detail
+	{
+		FORCE_INLINE __m256d load(const Vec4d& v) { return _mm256_load_pd(v.data()); }
+		FORCE_INLINE Vec4d toVec4d(__m256d m)
+		{
+			Vec4d res;
+			_mm256_store_pd(res.data(), m);
+			return res;
+		}
+
+		FORCE_INLINE double dot(__m256d a, __m256d b)
+		{
+			__m256d p = _mm256_mul_pd(a, b);
+			__m128d s = _mm_add_pd(_mm256_castpd256_pd128(p), _mm256_extractf128_pd(p, 1));
+			return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+		}
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator+(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Add());
+		return detail::toVec4d(_mm256_add_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator-(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Sub());
+		return detail::toVec4d(_mm256_sub_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator*(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Mul());
+		return detail::toVec4d(_mm256_mul_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator/(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Div());
+		return detail::toVec4d(_mm256_div_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator*(const Vec4d& a, double b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec4d(b), detail::Mul());
+		return detail::toVec4d(_mm256_mul_pd(detail::load(a), _mm256_set1_pd(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator*(double b, const Vec4d& a) { return a * b; }
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d operator/(const Vec4d& a, double b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, Vec4d(b), detail::Div());
+		return detail::toVec4d(_mm256_div_pd(detail::load(a), _mm256_set1_pd(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR double dot(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::dotScalar(a, b);
+		return detail::dot(detail::load(a), detail::load(b));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d min(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Min());
+		return detail::toVec4d(_mm256_min_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d max(const Vec4d& a, const Vec4d& b)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return detail::elementWise(a, b, detail::Max());
+		return detail::toVec4d(_mm256_max_pd(detail::load(a), detail::load(b)));
+	}
+
+	FORCE_INLINE MATH_SIMD_CONSTEXPR Vec4d abs(const Vec4d& a)
+	{
+		if(MATH_CONSTANT_EVALUATED())
+			return abs<double, 4>(a);
+		return detail::toVec4d(_mm256_andnot_pd(_mm256_set1_pd(-0.0), detail::load(a)));
+	}
+#endif // MATH_VECTOR_AVX
+#endif // MATH_VECTOR_SSE
+
 }	// namespace math
\ No newline at end of file
@@ -25,9 +25,13 @@
 
 #include <immintrin.h>
 #include <xmmintrin.h>
+#ifdef _MSC_VER
 #include <zmmintrin.h>
+#endif
 
 #include <array>
+#include <cstdint>
+#include "simd.h"
 #include "vector.h"
 
 namespace math
@@ -87,6 +91,29 @@ namespace math
 			return float4(_mm_cmpge_ps(m, b.m));
 		}
 
+		float4 operator<(const float4& b) const {
+			return float4(_mm_cmplt_ps(m, b.m));
+		}
+
+		float4 operator>(const float4& b) const {
+			return float4(_mm_cmpgt_ps(m, b.m));
+		}
+
+		// Bitwise operators, meant for combining comparison masks
+		float4 operator&(const float4& b) const {
+			return float4(_mm_and_ps(m, b.m));
+		}
+
+		float4 operator|(const float4& b) const {
+			return float4(_mm_or_ps(m, b.m));
+		}
+
+		// One bit per lane, set if the lane's sign bit is set
+		int mask() const
+		{
+			return _mm_movemask_ps(m);
+		}
+
 		bool any() const
 		{
 			return _mm_movemask_ps(m) != 0;
@@ -99,14 +126,14 @@ namespace math
 
 		bool all() const
 		{
-			return _mm_movemask_ps(m) == -1;
+			return _mm_movemask_ps(m) == 0xf;
 		}
 
 		template<uint8_t a, uint8_t b, uint8_t c, uint8_t d>
 		float4 shuffle() const
 		{
 			constexpr int mask = (d<<6)|(c<<4)|(b<<2)|a;
-			return float4(_mm_permute_ps(m,mask));
+			return float4(_mm_shuffle_ps(m,m,mask));
 		}
 
 		float hMin() const;
@@ -144,6 +171,12 @@ namespace math
 		return float4(_mm_max_ps(a.m,b.m));
 	}
 
+	// mask ? a : b, per lane. mask lanes must be all ones or all zeros, like comparison results
+	inline float4 select(float4 mask, float4 a, float4 b)
+	{
+		return float4(_mm_or_ps(_mm_and_ps(mask.m, a.m), _mm_andnot_ps(mask.m, b.m)));
+	}
+
 	inline float float4::hMin() const
 	{
 		float4 v = min(*this, shuffle<2,3,0,1>());
@@ -208,26 +241,63 @@ namespace math
 	// A pack of 4 vec3 implemented using simd packed 4 floats
 	using Vec3f4 = Vector3<float4>; // simd4 vectors of 3 components
 
+	// The 8-wide types need AVX2 and FMA. They are compiled for it regardless of the global flags,
+	// so they can be used from MATH_TARGET_AVX2 kernels (see simd.h) or from translation units built
+	// with AVX2 enabled. Other code must not use them directly, and kernels must check simdLevel().
+	MATH_AVX2_BEGIN
+
 	//-----------------------------------------------------------------
-	// Explicitly SIMD set of 8 Vec3fs
-	class float8
+	// Lane mask produced by float8 comparisons
+	class mask8
+	{
+	public:
+		mask8() = default;
+		explicit mask8(__m256 x) : m(x) {}
+		explicit mask8(bool x) : m(_mm256_castsi256_ps(_mm256_set1_epi32(x ? -1 : 0))) {}
+
+		mask8 operator&(const mask8& b) const { return mask8(_mm256_and_ps(m, b.m)); }
+		mask8 operator|(const mask8& b) const { return mask8(_mm256_or_ps(m, b.m)); }
+		mask8 operator^(const mask8& b) const { return mask8(_mm256_xor_ps(m, b.m)); }
+		mask8 operator~() const { return mask8(_mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))); }
+
+		// One bit per lane
+		int mask() const { return _mm256_movemask_ps(m); }
+		bool any() const { return mask() != 0; }
+		bool none() const { return mask() == 0; }
+		bool all() const { return mask() == 0xff; }
+
+		__m256 m;
+	};
+
+	//-----------------------------------------------------------------
+	// Explicitly SIMD set of 8 floats
+	class alignas(32) float8
 	{
 	public:
 		float8() = default;
-		explicit float8(const float* p) {
-			m = _mm256_load_ps(p);
-		}
 
+		// Lane i takes p[i]
 		explicit float8(const std::array<float,8>& p) {
-			m = _mm256_set_ps(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]);
+			m = _mm256_loadu_ps(p.data());
 		}
 
-		explicit float8(float x) {
+		float8(float x) {
 			m = _mm256_set1_ps(x);
 		}
 
 		explicit float8(__m256 x) : m(x) {}
 
+		// Loads and stores. The aligned versions need 32 byte aligned pointers
+		static float8 load(const float* p) { return float8(_mm256_load_ps(p)); }
+		static float8 loadu(const float* p) { return float8(_mm256_loadu_ps(p)); }
+		void store(float* p) const { _mm256_store_ps(p, m); }
+		void storeu(float* p) const { _mm256_storeu_ps(p, m); }
+
+		// Lane i takes base[index[i]]
+		static float8 gather(const float* base, const int32_t* index) {
+			return float8(_mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), 4));
+		}
+
 		float8 operator+(const float8& b) const
 		{
 			return float8(_mm256_add_ps(m, b.m));
@@ -248,13 +318,131 @@ namespace math
 			return float8(_mm256_div_ps(m, b.m));
 		}
 
+		float8 operator-() const
+		{
+			return float8(_mm256_xor_ps(m, _mm256_set1_ps(-0.f)));
+		}
+
+		float8& operator+=(const float8& b) { m = _mm256_add_ps(m, b.m); return *this; }
+		float8& operator-=(const float8& b) { m = _mm256_sub_ps(m, b.m); return *this; }
+		float8& operator*=(const float8& b) { m = _mm256_mul_ps(m, b.m); return *this; }
+		float8& operator/=(const float8& b) { m = _mm256_div_ps(m, b.m); return *this; }
+
+		// Ordered comparisons. Lanes with a NaN compare false
+		mask8 operator<(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_LT_OQ)); }
+		mask8 operator<=(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_LE_OQ)); }
+		mask8 operator>(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_GT_OQ)); }
+		mask8 operator>=(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_GE_OQ)); }
+		mask8 operator==(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_EQ_OQ)); }
+		mask8 operator!=(const float8& b) const { return mask8(_mm256_cmp_ps(m, b.m, _CMP_NEQ_UQ)); }
+
 		// this*b + c;
-		float8 mul_add(const float8& b, const float8& c)
+		float8 mul_add(const float8& b, const float8& c) const
 		{
 			return float8(_mm256_fmadd_ps(m,b.m,c.m));
 		}
 
-	private:
+		float operator[](int i) const
+		{
+			alignas(32) float lanes[8];
+			store(lanes);
+			return lanes[i];
+		}
+
+		float hMin() const;
+		float hMax() const;
+		float hSum() const;
+
 		__m256 m;
 	};
+
+	// Scalar on the left hand side
+	inline float8 operator+(float a, const float8& b) { return float8(a) + b; }
+	inline float8 operator-(float a, const float8& b) { return float8(a) - b; }
+	inline float8 operator*(float a, const float8& b) { return float8(a) * b; }
+	inline float8 operator/(float a, const float8& b) { return float8(a) / b; }
+
+	inline float8 min(const float8& a, const float8& b)
+	{
+		return float8(_mm256_min_ps(a.m, b.m));
+	}
+
+	inline float8 max(const float8& a, const float8& b)
+	{
+		return float8(_mm256_max_ps(a.m, b.m));
+	}
+
+	inline float8 abs(const float8& a)
+	{
+		return float8(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.m));
+	}
+
+	inline float8 sqrt(const float8& a)
+	{
+		return float8(_mm256_sqrt_ps(a.m));
+	}
+
+	// Approximate 1/sqrt(a), 12 bits of precision
+	inline float8 rsqrt(const float8& a)
+	{
+		return float8(_mm256_rsqrt_ps(a.m));
+	}
+
+	// mask ? a : b, per lane
+	inline float8 select(const mask8& mask, const float8& a, const float8& b)
+	{
+		return float8(_mm256_blendv_ps(b.m, a.m, mask.m));
+	}
+
+	inline float float8::hMin() const
+	{
+		__m128 v = _mm_min_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+		return float4(v).hMin();
+	}
+
+	inline float float8::hMax() const
+	{
+		__m128 v = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+		return float4(v).hMax();
+	}
+
+	inline float float8::hSum() const
+	{
+		__m128 v = _mm_add_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+		v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+		return _mm_cvtss_f32(v);
+	}
+
+	//-----------------------------------------------------------------
+	// A pack of 8 vec3 in SoA layout, one float8 per component
+	using Vec3f8 = Vector3<float8>;
+
+	inline Vec3f8 select(const mask8& mask, const Vec3f8& a, const Vec3f8& b)
+	{
+		return Vec3f8(select(mask, a.x(), b.x()), select(mask, a.y(), b.y()), select(mask, a.z(), b.z()));
+	}
+
+	inline Vec3f8 min(const Vec3f8& a, const Vec3f8& b)
+	{
+		return Vec3f8(min(a.x(), b.x()), min(a.y(), b.y()), min(a.z(), b.z()));
+	}
+
+	inline Vec3f8 max(const Vec3f8& a, const Vec3f8& b)
+	{
+		return Vec3f8(max(a.x(), b.x()), max(a.y(), b.y()), max(a.z(), b.z()));
+	}
+
+	inline float8 dot(const Vec3f8& a, const Vec3f8& b)
+	{
+		return a.x().mul_add(b.x(), a.y().mul_add(b.y(), a.z() * b.z()));
+	}
+
+	inline Vec3f8 normalize(const Vec3f8& v)
+	{
+		float8 rcpNorm = 1.f / sqrt(dot(v, v));
+		return Vec3f8(v.x() * rcpNorm, v.y() * rcpNorm, v.z() * rcpNorm);
+	}
+
+	MATH_AVX2_END
 }
@@ -0,0 +1,284 @@
+// Headless scaling benchmark for the Segway physics world.
+// Builds reproducible worlds of increasing size, steps them for a fixed number of frames
+// and prints per phase timings, allocation counts and cache misses as JSON.
+
+#include "cmdLineParser.h"
+#include "physics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------------------------
+// Allocation tracking
+namespace
+{
+    uint64_t gNumAllocations = 0;
+    uint64_t gAllocatedBytes = 0;
+}
+
+void* operator new(size_t size)
+{
+    ++gNumAllocations;
+    gAllocatedBytes += size;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+//----------------------------------------------------------------------------------------------
+// Hardware cache miss counter. Reports nothing where perf_event_open isn't available.
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+    {
+#if defined(__linux__)
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#if defined(__linux__)
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    bool available() const { return m_fd >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (m_fd < 0)
+            return;
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#if defined(__linux__)
+        if (m_fd < 0)
+            return 0;
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+//----------------------------------------------------------------------------------------------
+// A world of n particles, with springs, pivots and obstacles, all generated from a seed.
+// Particles start on a jittered grid, so density stays constant as n grows and collision work per
+// particle stays comparable. Springs only join grid neighbours, at their initial distance, so the
+// world stays stable and the benchmark measures normal stepping rather than an explosion.
+struct BenchWorld
+{
+    BenchWorld(int numParticles, int seed)
+    {
+        math::SquirrelRng rng;
+        rng.m_state = seed;
+
+        const int gridSize = int(std::ceil(std::sqrt(float(numParticles))));
+        const float spacing = 4.f;
+        const float halfSize = 0.5f * spacing * gridSize;
+        const float radius = 0.5f;
+        const float jitter = 0.5f;
+
+        m_bodies.reserve(numParticles);
+        m_colliders.reserve(numParticles);
+        for (int i = 0; i < numParticles; ++i)
+        {
+            const int row = i / gridSize;
+            const int column = i % gridSize;
+            const Vec2f cell(-halfSize + (column + 0.5f) * spacing, -halfSize + (row + 0.5f) * spacing);
+
+            auto& body = m_bodies.emplace_back(std::make_unique<RigidBody>());
+            body->m_InvMass = (i % 16) ? 1.f : 0.f; // Some kinematic bodies
+            body->m_InvInertia = body->m_InvMass;
+            body->m_Position = cell + Vec2f(rng.uniform(-jitter, jitter), rng.uniform(-jitter, jitter));
+            body->m_LinearVelocity = Vec2f(rng.uniform(-0.5f, 0.5f), rng.uniform(-0.5f, 0.5f));
+            body->ResetInterpolation();
+
+            auto& collider = m_colliders.emplace_back(std::make_unique<Circle>(radius));
+            collider->m_pos = body->m_Position;
+            body->m_Collider = collider.get();
+
+            m_world.AddRigidBody(*body);
+            m_world.AddCollider(*collider);
+        }
+
+        // Chain each particle to its right neighbour in the grid
+        for (int i = 0; i + 1 < numParticles; ++i)
+        {
+            if ((i + 1) % gridSize == 0)
+                continue; // End of a row
+            RigidBody& a = *m_bodies[i];
+            RigidBody& b = *m_bodies[i + 1];
+            const float restLength = (b.m_Position - a.m_Position).norm();
+            auto& spring = m_springs.emplace_back(std::make_unique<Spring>(a, b, restLength, 10.f));
+            m_world.AddForceGenerator(*spring);
+        }
+
+        // Pin some of the dynamic particles
+        for (int i = 1; i < numParticles; i += 10)
+        {
+            if (m_bodies[i]->m_InvMass == 0)
+                continue;
+            const float armLen = rng.uniform(1.f, 3.f);
+            auto& pivot = m_pivots.emplace_back(std::make_unique<PivotConstraint>(*m_bodies[i], m_bodies[i]->m_Position + Vec2f(armLen, 0.f), armLen));
+            m_world.AddConstraint(*pivot);
+        }
+
+        // Thin obstacles scattered around, and a ground slab below everything
+        const int numObstacles = std::max(1, numParticles / 10);
+        for (int i = 0; i < numObstacles; ++i)
+        {
+            Vec2f pos(rng.uniform(-halfSize, halfSize), rng.uniform(-halfSize, halfSize));
+            Vec2f size(rng.uniform(0.1f, 4.f), rng.uniform(0.1f, 4.f));
+            auto& box = m_obstacles.emplace_back(std::make_unique<KinematicAABB>(pos, pos + size));
+            m_world.AddKinematicBody(*box);
+        }
+        auto& ground = m_obstacles.emplace_back(std::make_unique<KinematicAABB>(Vec2f(-halfSize, -halfSize - 1.f), Vec2f(halfSize, -halfSize)));
+        m_world.AddKinematicBody(*ground);
+    }
+
+    RigidBodyWorld m_world;
+    std::vector<std::unique_ptr<RigidBody>> m_bodies;
+    std::vector<std::unique_ptr<Circle>> m_colliders;
+    std::vector<std::unique_ptr<Spring>> m_springs;
+    std::vector<std::unique_ptr<PivotConstraint>> m_pivots;
+    std::vector<std::unique_ptr<KinematicAABB>> m_obstacles;
+};
+
+//----------------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    int seed = 0;
+    int numFrames = 100;
+    int minParticles = 10;
+    int maxParticles = 1000000;
+    double budget = 60; // Seconds per world size. Larger sizes are skipped once a size exceeds it
+    std::string outFile;
+
+    CmdLineParser parser;
+    parser.addOption("seed", &seed);
+    parser.addOption("frames", &numFrames);
+    parser.addOption("minN", &minParticles);
+    parser.addOption("maxN", &maxParticles);
+    parser.addOption("budget", &budget);
+    parser.addOption("out", &outFile);
+    parser.parse(argc, const_cast<const char**>(argv));
+
+    FILE* out = outFile.empty() ? stdout : fopen(outFile.c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "Error: Unable to open %s\n", outFile.c_str());
+        return -1;
+    }
+
+    CacheMissCounter cacheMisses;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"seed\": %d,\n  \"frames\": %d,\n", seed, numFrames);
+    fprintf(out, "  \"results\": [");
+
+    bool overBudget = false;
+    bool first = true;
+    for (int64_t n = minParticles; n <= maxParticles; n *= 10)
+    {
+        fprintf(out, first ? "\n" : ",\n");
+        first = false;
+        if (overBudget)
+        {
+            fprintf(out, "    { \"particles\": %lld, \"skipped\": true }", (long long)n);
+            continue;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        auto buildStart = Clock::now();
+        auto bench = std::make_unique<BenchWorld>(int(n), seed);
+        RigidBodyWorld& world = bench->m_world;
+        world.m_profilePhases = true;
+        world.Update(world.m_fixedStepSize); // Warm up. Builds acceleration structures.
+        world.m_timings = {};
+        const double buildTime = std::chrono::duration<double>(Clock::now() - buildStart).count();
+
+        const uint64_t allocations0 = gNumAllocations;
+        const uint64_t bytes0 = gAllocatedBytes;
+        cacheMisses.start();
+        auto stepStart = Clock::now();
+        for (int i = 0; i < numFrames; ++i)
+        {
+            world.Update(world.m_fixedStepSize);
+        }
+        const double stepTime = std::chrono::duration<double>(Clock::now() - stepStart).count();
+        const uint64_t misses = cacheMisses.stop();
+
+        const auto& t = world.m_timings;
+        const double toMs = 1000.0 / std::max(1, t.numSteps);
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"particles\": %lld,\n", (long long)n);
+        fprintf(out, "      \"springs\": %zu,\n", bench->m_springs.size());
+        fprintf(out, "      \"pivots\": %zu,\n", bench->m_pivots.size());
+        fprintf(out, "      \"obstacles\": %zu,\n", bench->m_obstacles.size());
+        fprintf(out, "      \"buildSeconds\": %.6f,\n", buildTime);
+        fprintf(out, "      \"stepSeconds\": %.6f,\n", stepTime);
+        fprintf(out, "      \"msPerStep\": { \"collision\": %.6f, \"forces\": %.6f, \"constraints\": %.6f, \"integration\": %.6f, \"sensors\": %.6f },\n",
+            t.collision * toMs, t.forces * toMs, t.constraints * toMs, t.integration * toMs, t.sensors * toMs);
+        fprintf(out, "      \"allocations\": %llu,\n", (unsigned long long)(gNumAllocations - allocations0));
+        fprintf(out, "      \"allocatedBytes\": %llu,\n", (unsigned long long)(gAllocatedBytes - bytes0));
+        if (cacheMisses.available())
+            fprintf(out, "      \"cacheMisses\": %llu\n", (unsigned long long)misses);
+        else
+            fprintf(out, "      \"cacheMisses\": null\n");
+        fprintf(out, "    }");
+        fflush(out);
+
+        overBudget = buildTime + stepTime > budget;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Orbit drawing benchmark.
+// Each thread zooms in and out of the inner solar system like a viewer would, plotting Earth, Mars
+// and a circular orbit into its own polylines every frame. Prints the time per frame, the number
+// of rebuilds and points, and the largest distance found between a segment and its orbit, as JSON.
+
+#include "cmdLineParser.h"
+#include "orbits.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr double AU = 1.495978707e11; // Meters
+
+	struct DrawStats
+	{
+		int rebuilds = 0;
+		int maxPoints = 0;
+		double maxErrorRatio = 0; // Largest segment to orbit distance, over its tolerance
+	};
+
+	// Distance between the orbit and the middle of each segment, where chords stray the most.
+	// Measured along the radius, which is at most a few percent over the true distance.
+	template<class RadiusAt>
+	double maxError(const OrbitPolyline& line, const RadiusAt& radiusAt)
+	{
+		double error = 0;
+		for (int i = 0; i + 1 < line.size(); ++i)
+		{
+			const double x = 0.5 * (double(line.x[i]) + line.x[i + 1]);
+			const double y = 0.5 * (double(line.y[i]) + line.y[i + 1]);
+			error = std::max(error, std::abs(std::hypot(x, y) - radiusAt(std::atan2(y, x))));
+		}
+		return error;
+	}
+
+	// Zooms from viewSize down by zoomRange and back, once per numFrames, with a pixel wide tolerance
+	template<class Orbit, class RadiusAt>
+	DrawStats draw(const Orbit& orbit, const RadiusAt& radiusAt, int numFrames, double viewSize, double zoomRange, int numPixels, bool check)
+	{
+		DrawStats stats;
+		OrbitPolyline line;
+		for (int frame = 0; frame < numFrames; ++frame)
+		{
+			const double phase = 1 - std::abs(2.0 * frame / numFrames - 1);
+			const double tolerance = 0.5 * viewSize * std::pow(zoomRange, -phase) / numPixels;
+			const double before = line.tolerance;
+			orbit.plot(tolerance, line);
+			if (line.tolerance == before)
+				continue;
+
+			++stats.rebuilds;
+			stats.maxPoints = std::max(stats.maxPoints, line.size());
+			if (check)
+				stats.maxErrorRatio = std::max(stats.maxErrorRatio, maxError(line, radiusAt) / line.tolerance);
+		}
+		return stats;
+	}
+}
+
+//----------------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	int numThreads = 4;
+	int numFrames = 10000;
+	int numPixels = 1000; // View width
+	double zoomRange = 1000; // Ratio between the widest and closest views
+	bool noCheck = false; // Skips measuring the error, to time plotting alone
+	std::string outFile;
+
+	CmdLineParser parser;
+	parser.addOption("threads", &numThreads);
+	parser.addOption("frames", &numFrames);
+	parser.addOption("pixels", &numPixels);
+	parser.addOption("zoom", &zoomRange);
+	parser.addFlag("nocheck", noCheck);
+	parser.addOption("out", &outFile);
+	parser.parse(argc, const_cast<const char**>(argv));
+
+	if (numThreads < 1 || numFrames < 1 || numPixels < 1 || zoomRange < 1)
+	{
+		fprintf(stderr, "Error: threads, frames, pixels and zoom must be positive\n");
+		return -1;
+	}
+
+	FILE* out = outFile.empty() ? stdout : fopen(outFile.c_str(), "w");
+	if (!out)
+	{
+		fprintf(stderr, "Error: Unable to open %s\n", outFile.c_str());
+		return -1;
+	}
+
+	const bool check = !noCheck;
+
+	// All threads plot the same orbits, each into its own polylines
+	const CircularOrbit circularOrbit(AU, SolarMass);
+	const auto conicRadius = [](const ConicOrbit& orbit) {
+		return [&orbit](double angle) { return orbit.radius(angle); };
+	};
+	const auto circularRadius = [&](double) { return circularOrbit.radius(); };
+	constexpr int kNumOrbits = 3;
+	const char* names[kNumOrbits] = { "earth", "mars", "circular" };
+	std::vector<DrawStats> stats(numThreads * kNumOrbits);
+
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]() {
+			DrawStats* dst = &stats[t * kNumOrbits];
+			dst[0] = draw(EarthOrbit, conicRadius(EarthOrbit), numFrames, 4 * AU, zoomRange, numPixels, check);
+			dst[1] = draw(MarsOrbit, conicRadius(MarsOrbit), numFrames, 4 * AU, zoomRange, numPixels, check);
+			dst[2] = draw(circularOrbit, circularRadius, numFrames, 4 * AU, zoomRange, numPixels, check);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Every thread must have drawn the same polylines
+	bool consistent = true;
+	for (int i = kNumOrbits; i < int(stats.size()); ++i)
+	{
+		const auto& a = stats[i];
+		const auto& b = stats[i % kNumOrbits];
+		consistent &= a.rebuilds == b.rebuilds && a.maxPoints == b.maxPoints && a.maxErrorRatio == b.maxErrorRatio;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"threads\": %d,\n  \"frames\": %d,\n  \"pixels\": %d,\n  \"zoom\": %.1f,\n", numThreads, numFrames, numPixels, zoomRange);
+	fprintf(out, "  \"usPerFrame\": %.3f,\n", seconds * 1e6 / (double(numFrames) * numThreads));
+	fprintf(out, "  \"orbits\": {\n");
+	for (int i = 0; i < kNumOrbits; ++i)
+		fprintf(out, "    \"%s\": { \"rebuilds\": %d, \"maxPoints\": %d, \"maxErrorRatio\": %.3f }%s\n",
+			names[i], stats[i].rebuilds, stats[i].maxPoints, stats[i].maxErrorRatio, i + 1 < kNumOrbits ? "," : "");
+	fprintf(out, "  },\n  \"consistent\": %s\n}\n", consistent ? "true" : "false");
+
+	if (out != stdout)
+		fclose(out);
+	return consistent ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Headless Earth to Mars porkchop generator.
+// Fits ephemerides for both planets over the requested dates, solves the transfer for every
+// cell of the departure x arrival grid and writes it as a binary PorkchopGrid.
+
+#include "cmdLineParser.h"
+#include "porkchop.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Parses YYYY-MM-DD into seconds since J2000
+static bool parseDate(const std::string& text, double& seconds)
+{
+	int y, m, d;
+	if (sscanf(text.c_str(), "%d-%d-%d", &y, &m, &d) != 3)
+		return false;
+	const year_month_day date{ year(y), month(unsigned(m)), day(unsigned(d)) };
+	if (!date.ok())
+		return false;
+	seconds = secondsSinceJ2000(sys_days(date));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	// Defaults cover the 2026 Earth-Mars window
+	std::string departureFrom = "2026-09-01";
+	std::string departureTo = "2027-01-01";
+	std::string arrivalFrom = "2027-05-01";
+	std::string arrivalTo = "2028-03-01";
+	int numDepartures = 1000;
+	int numArrivals = 1000;
+	int numThreads = 0;
+	std::string ephemerisFile;
+	std::string outFile = "porkchop.bin";
+
+	CmdLineParser parser;
+	parser.addOption("depFrom", &departureFrom);
+	parser.addOption("depTo", &departureTo);
+	parser.addOption("arrFrom", &arrivalFrom);
+	parser.addOption("arrTo", &arrivalTo);
+	parser.addOption("numDep", &numDepartures);
+	parser.addOption("numArr", &numArrivals);
+	parser.addOption("threads", &numThreads);
+	parser.addOption("ephemeris", &ephemerisFile); // Cached if it exists, written otherwise
+	parser.addOption("out", &outFile);
+	parser.parse(argc, const_cast<const char**>(argv));
+
+	double depStart, depEnd, arrStart, arrEnd;
+	if (!parseDate(departureFrom, depStart) || !parseDate(departureTo, depEnd)
+		|| !parseDate(arrivalFrom, arrStart) || !parseDate(arrivalTo, arrEnd))
+	{
+		fprintf(stderr, "Error: Dates must be YYYY-MM-DD\n");
+		return -1;
+	}
+	if (numDepartures < 1 || numArrivals < 1 || numThreads < 0)
+	{
+		fprintf(stderr, "Error: Invalid grid size or thread count\n");
+		return -1;
+	}
+
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+
+	ChebyshevEphemeris earth, mars;
+	const bool cached = !ephemerisFile.empty() && ChebyshevEphemeris::load(ephemerisFile.c_str(), { &earth, &mars })
+		&& earth.start() <= depStart && earth.end() >= depEnd && mars.start() <= arrStart && mars.end() >= arrEnd;
+	if (!cached)
+	{
+		const double first = std::min(depStart, arrStart);
+		const double last = std::max(depEnd, arrEnd);
+		earth = ChebyshevEphemeris(EarthOrbit, first, last);
+		mars = ChebyshevEphemeris(MarsOrbit, first, last);
+		if (!ephemerisFile.empty() && !ChebyshevEphemeris::save(ephemerisFile.c_str(), { &earth, &mars }))
+			fprintf(stderr, "Warning: Unable to write %s\n", ephemerisFile.c_str());
+	}
+	auto fitted = Clock::now();
+
+	const auto grid = computePorkchop(earth, mars, SolarGravitationalConstant,
+		depStart, depEnd, numDepartures, arrStart, arrEnd, numArrivals, unsigned(numThreads));
+	auto solved = Clock::now();
+
+	// Cheapest departure
+	size_t best = 0;
+	for (size_t i = 1; i < grid.c3.size(); ++i)
+		if (grid.c3[i] < grid.c3[best])
+			best = i;
+
+	if (!grid.save(outFile.c_str()))
+	{
+		fprintf(stderr, "Error: Unable to write %s\n", outFile.c_str());
+		return -1;
+	}
+
+	const auto seconds = [](auto a, auto b) { return std::chrono::duration<double>(b - a).count(); };
+	printf("Ephemeris %s in %.3f s\n", cached ? "loaded" : "fitted", seconds(start, fitted));
+	printf("%d x %d transfers in %.3f s\n", numDepartures, numArrivals, seconds(fitted, solved));
+	printf("Min C3 %.2f km^2/s^2, departing day %.1f, arriving day %.1f after J2000\n", grid.c3[best],
+		daysFromSeconds(grid.departure(int(best % numDepartures))), daysFromSeconds(grid.arrival(int(best / numDepartures))));
+	return 0;
+}
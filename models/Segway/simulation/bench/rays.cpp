@@ -0,0 +1,253 @@
+// Microbenchmark of the ray packet kernels in math/rayPacket.h.
+// Finds the closest hit of every ray against every box of a random scene, by brute force, once per
+// kernel, and prints the time per ray box test as JSON. All kernels must find the same hits.
+
+#include "cmdLineParser.h"
+
+#include <math/noise.h>
+#include <math/rayPacket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace math;
+
+namespace
+{
+	constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+	struct Scene
+	{
+		Scene(int numRays, int numBoxes, int seed)
+		{
+			SquirrelRng rng;
+			rng.m_state = seed;
+
+			// Small boxes scattered in a 100m cube, so most rays hit a few of them
+			boxes.reserve(numBoxes);
+			for (int i = 0; i < numBoxes; ++i)
+			{
+				const Vec3f pos(rng.uniform(-50.f, 50.f), rng.uniform(-50.f, 50.f), rng.uniform(-50.f, 50.f));
+				const Vec3f size(rng.uniform(0.5f, 5.f), rng.uniform(0.5f, 5.f), rng.uniform(0.5f, 5.f));
+				boxes.emplace_back(pos, pos + size);
+			}
+			for (int i = 0; i < numBoxes; i += 4)
+				boxes4.emplace_back(&boxes[i], std::min(4, numBoxes - i));
+
+			// Rays from around the center, like a lidar sweep
+			rays.reserve(numRays);
+			for (int i = 0; i < numRays; ++i)
+			{
+				const float theta = rng.uniform(0.f, 6.2831853f);
+				const float z = rng.uniform(-1.f, 1.f);
+				const float r = std::sqrt(1 - z * z);
+				const Vec3f origin(rng.uniform(-1.f, 1.f), rng.uniform(-1.f, 1.f), rng.uniform(-1.f, 1.f));
+				rays.emplace_back(origin, Vec3f(r * std::cos(theta), r * std::sin(theta), z));
+			}
+		}
+
+		std::vector<Ray> rays;
+		std::vector<AABB> boxes;
+		std::vector<AABB4> boxes4;
+	};
+
+	// Closest hit distance per ray, infinity on miss
+	using Kernel = void (*)(const Scene&, float* tHit);
+
+	void scalarRays(const Scene& scene, float* tHit)
+	{
+		for (size_t r = 0; r < scene.rays.size(); ++r)
+		{
+			const Ray::Implicit ray = scene.rays[r].implicit();
+			float tMax = kInfinity;
+			for (const AABB& box : scene.boxes)
+			{
+				float t;
+				if (box.intersect(ray, 0.f, tMax, t))
+					tMax = t;
+			}
+			tHit[r] = tMax;
+		}
+	}
+
+	void packet4(const Scene& scene, float* tHit)
+	{
+		const int numRays = int(scene.rays.size());
+		for (int r = 0; r < numRays; r += 4)
+		{
+			const int count = std::min(4, numRays - r);
+			RayPacket4 packet(&scene.rays[r], count, 0.f, kInfinity);
+			for (const AABB& box : scene.boxes)
+			{
+				float4 tEnter;
+				const int hits = intersect(packet, box, tEnter);
+				packet.shrink(hits, tEnter);
+			}
+			alignas(16) float t[4];
+			_mm_store_ps(t, packet.tMax.m);
+			std::copy(t, t + count, &tHit[r]);
+		}
+	}
+
+	void boxes4(const Scene& scene, float* tHit)
+	{
+		for (size_t r = 0; r < scene.rays.size(); ++r)
+		{
+			const Ray::Implicit ray = scene.rays[r].implicit();
+			float tMax = kInfinity;
+			for (const AABB4& boxes : scene.boxes4)
+			{
+				float4 tEnter;
+				if (const int hits = intersect(ray, 0.f, tMax, boxes, tEnter))
+					tMax = select(RayPacket4::laneMask(hits), tEnter, float4(kInfinity)).hMin();
+			}
+			tHit[r] = tMax;
+		}
+	}
+
+	MATH_AVX2_BEGIN
+	void packet8(const Scene& scene, float* tHit)
+	{
+		const int numRays = int(scene.rays.size());
+		for (int r = 0; r < numRays; r += 8)
+		{
+			const int count = std::min(8, numRays - r);
+			RayPacket8 packet(&scene.rays[r], count, 0.f, kInfinity);
+			for (const AABB& box : scene.boxes)
+			{
+				float8 tEnter;
+				const int hits = intersect(packet, box, tEnter);
+				packet.shrink(hits, tEnter);
+			}
+			alignas(32) float t[8];
+			packet.tMax.store(t);
+			std::copy(t, t + count, &tHit[r]);
+		}
+	}
+
+	void boxes8(const Scene& scene, float* tHit)
+	{
+		// Packed here, so the scene doesn't depend on AVX2
+		std::vector<AABB8> packed;
+		const int numBoxes = int(scene.boxes.size());
+		for (int i = 0; i < numBoxes; i += 8)
+			packed.emplace_back(&scene.boxes[i], std::min(8, numBoxes - i));
+
+		for (size_t r = 0; r < scene.rays.size(); ++r)
+		{
+			const Ray::Implicit ray = scene.rays[r].implicit();
+			float tMax = kInfinity;
+			for (const AABB8& boxes : packed)
+			{
+				float8 tEnter;
+				if (const int hits = intersect(ray, 0.f, tMax, boxes, tEnter))
+					tMax = select(RayPacket8::laneMask(hits), tEnter, float8(kInfinity)).hMin();
+			}
+			tHit[r] = tMax;
+		}
+	}
+	MATH_AVX2_END
+}
+
+//----------------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	int seed = 0;
+	int numRays = 4096;
+	int numBoxes = 1024;
+	int repeats = 5; // Best of
+	std::string outFile;
+
+	CmdLineParser parser;
+	parser.addOption("seed", &seed);
+	parser.addOption("rays", &numRays);
+	parser.addOption("boxes", &numBoxes);
+	parser.addOption("repeats", &repeats);
+	parser.addOption("out", &outFile);
+	parser.parse(argc, const_cast<const char**>(argv));
+
+	if (numRays < 1 || numBoxes < 1 || repeats < 1)
+	{
+		fprintf(stderr, "Error: rays, boxes and repeats must be positive\n");
+		return -1;
+	}
+
+	FILE* out = outFile.empty() ? stdout : fopen(outFile.c_str(), "w");
+	if (!out)
+	{
+		fprintf(stderr, "Error: Unable to open %s\n", outFile.c_str());
+		return -1;
+	}
+
+	const Scene scene(numRays, numBoxes, seed);
+	const bool avx2 = simdLevel() >= SimdLevel::AVX2;
+	struct Entry { const char* name; Kernel kernel; };
+	const Entry kernels[] = {
+		{ "scalar", &scalarRays },
+		{ "packet4", &packet4 },
+		{ "boxes4", &boxes4 },
+		{ "packet8", avx2 ? &packet8 : nullptr },
+		{ "boxes8", avx2 ? &boxes8 : nullptr },
+	};
+
+	std::vector<float> reference(numRays), tHit(numRays);
+	scalarRays(scene, reference.data());
+	int numHits = 0;
+	for (float t : reference)
+		numHits += t < kInfinity;
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"seed\": %d,\n  \"rays\": %d,\n  \"boxes\": %d,\n  \"hits\": %d,\n  \"simd\": \"%s\",\n",
+		seed, numRays, numBoxes, numHits, simdLevelName(simdLevel()));
+	fprintf(out, "  \"results\": [");
+
+	bool allMatch = true;
+	double scalarTime = 0;
+	bool first = true;
+	for (const Entry& entry : kernels)
+	{
+		fprintf(out, first ? "\n" : ",\n");
+		first = false;
+		if (!entry.kernel)
+		{
+			fprintf(out, "    { \"kernel\": \"%s\", \"skipped\": true }", entry.name);
+			continue;
+		}
+
+		using Clock = std::chrono::steady_clock;
+		double best = kInfinity;
+		for (int i = 0; i < repeats; ++i)
+		{
+			const auto start = Clock::now();
+			entry.kernel(scene, tHit.data());
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+		if (entry.kernel == &scalarRays)
+			scalarTime = best;
+
+		// Packets don't round differently, but compare with a tolerance in case of FMA contraction
+		int mismatches = 0;
+		for (int r = 0; r < numRays; ++r)
+		{
+			const float a = reference[r], b = tHit[r];
+			if (a != b && !(std::abs(a - b) <= 1e-5f * std::abs(a)))
+				++mismatches;
+		}
+		allMatch = allMatch && mismatches == 0;
+
+		const double tests = double(numRays) * numBoxes;
+		fprintf(out, "    { \"kernel\": \"%s\", \"seconds\": %.6f, \"nsPerTest\": %.4f, \"speedup\": %.2f, \"mismatches\": %d }",
+			entry.name, best, best * 1e9 / tests, scalarTime / best, mismatches);
+		fflush(out);
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	if (out != stdout)
+		fclose(out);
+	return allMatch ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+#pragma once
+// Kepler's equation solvers.
+// Elliptic: M = E - e sin(E), for 0 <= e < 1. Hyperbolic: M = e sinh(H) - H, for e > 1.
+// Parabolic: Barker's equation M = D + D^3 / 3, with D = tan(nu / 2).
+// The elliptic and hyperbolic ones use Danby's starter and Halley iterations. Residuals end within
+// an ulp or two of M, after 2 or 3 iterations for planetary eccentricities and a few more as e -> 1.
+// The batched elliptic solver runs 4 orbits per AVX2 lane set, with its own double sin/cos.
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+
+#include <math/simd.h>
+#include <math/vector.h>
+
+namespace kepler
+{
+	namespace detail
+	{
+		constexpr double kPi = std::numbers::pi_v<double>;
+		constexpr double kTwoPi = 2 * std::numbers::pi_v<double>;
+		// Halley steps converge cubically, so once a step is this small the error left is far below an ulp
+		constexpr double kStepTolerance = 1e-9;
+		constexpr int kMaxIterations = 32;
+
+		// Mean anomaly reduced to [-pi, pi], and the number of whole turns removed
+		inline double reduceAngle(double M, double& turns)
+		{
+			turns = std::nearbyint(M * (1 / kTwoPi));
+			return M - turns * kTwoPi;
+		}
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Eccentric anomaly E of an elliptic orbit, with its sine and cosine.
+	inline double eccentricAnomaly(double M, double e, double& sinE, double& cosE)
+	{
+		assert(e >= 0 && e < 1);
+		double turns;
+		const double m = detail::reduceAngle(M, turns);
+
+		double E = m + 0.85 * e * (m < 0 ? -1 : 1); // Danby's starter
+		double d = 0;
+		for (int i = 0; i < detail::kMaxIterations; ++i)
+		{
+			sinE = std::sin(E);
+			cosE = std::cos(E);
+			const double f = E - e * sinE - m;
+			const double fp = 1 - e * cosE;
+			const double fpp = e * sinE;
+			d = -f * fp / (fp * fp - 0.5 * f * fpp);
+			E += d;
+			if (std::abs(d) <= detail::kStepTolerance)
+				break;
+		}
+		// Bring sin and cos along with the last step
+		const double s = sinE;
+		sinE += cosE * d - 0.5 * s * d * d;
+		cosE -= s * d + 0.5 * cosE * d * d;
+
+		return E + turns * detail::kTwoPi;
+	}
+
+	inline double eccentricAnomaly(double M, double e)
+	{
+		double s, c;
+		return eccentricAnomaly(M, e, s, c);
+	}
+
+	// Hyperbolic anomaly H. M is unbounded here, there are no turns to reduce.
+	inline double hyperbolicAnomaly(double M, double e)
+	{
+		assert(e > 1);
+		const double sign = M < 0 ? -1 : 1;
+		double H = sign * std::log(2 * std::abs(M) / e + 1.8); // Danby's starter
+		for (int i = 0; i < detail::kMaxIterations; ++i)
+		{
+			const double sh = std::sinh(H);
+			const double ch = std::cosh(H);
+			const double f = e * sh - H - M;
+			const double fp = e * ch - 1;
+			const double fpp = e * sh;
+			const double d = -f * fp / (fp * fp - 0.5 * f * fpp);
+			H += d;
+			if (std::abs(d) <= detail::kStepTolerance * (1 + std::abs(H)))
+				break;
+		}
+		return H;
+	}
+
+	// Closed form solution of Barker's equation. Returns D = tan(nu / 2).
+	inline double parabolicAnomaly(double M)
+	{
+		const double w = 1.5 * M;
+		const double y = std::cbrt(w + std::sqrt(w * w + 1));
+		return y - 1 / y;
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// True anomaly from the eccentric, hyperbolic and parabolic anomalies
+	inline double trueAnomalyFromEccentric(double E, double e)
+	{
+		return 2 * std::atan2(std::sqrt(1 + e) * std::sin(0.5 * E), std::sqrt(1 - e) * std::cos(0.5 * E));
+	}
+
+	inline double trueAnomalyFromHyperbolic(double H, double e)
+	{
+		return 2 * std::atan(std::sqrt((e + 1) / (e - 1)) * std::tanh(0.5 * H));
+	}
+
+	inline double trueAnomalyFromParabolic(double D)
+	{
+		return 2 * std::atan(D);
+	}
+
+	// Any conic. For e < 1 the result is in the same turn as M, otherwise in (-pi, pi)
+	inline double trueAnomaly(double M, double e)
+	{
+		if (e < 1)
+			return trueAnomalyFromEccentric(eccentricAnomaly(M, e), e);
+		if (e > 1)
+			return trueAnomalyFromHyperbolic(hyperbolicAnomaly(M, e), e);
+		return trueAnomalyFromParabolic(parabolicAnomaly(M));
+	}
+
+	//---------------------------------------------------------------------------------------------
+	// Batched elliptic solver. eStride is 1 for one eccentricity per anomaly, or 0 to share e[0].
+	// Outputs may be null, except E.
+	namespace detail
+	{
+		using KeplerKernel = void(*)(const double* M, const double* e, size_t eStride,
+			double* E, double* sinE, double* cosE, size_t count);
+
+		inline void solveScalar(const double* M, const double* e, size_t eStride,
+			double* E, double* sinE, double* cosE, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				double s, c;
+				E[i] = eccentricAnomaly(M[i], e[i * eStride], s, c);
+				if (sinE) sinE[i] = s;
+				if (cosE) cosE[i] = c;
+			}
+		}
+
+		MATH_AVX2_BEGIN
+		// sin and cos of 4 doubles, for |x| up to a few thousands. Cody-Waite reduction to
+		// [-pi/4, pi/4] and the Cephes polynomials, within 1 ulp of libm in that range.
+		FORCE_INLINE void sincos4(__m256d x, __m256d& s, __m256d& c)
+		{
+			const __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(2 / kPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			__m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(1.57079632673412561417e0), x);
+			r = _mm256_fnmadd_pd(k, _mm256_set1_pd(6.07710050650619224932e-11), r);
+			r = _mm256_fnmadd_pd(k, _mm256_set1_pd(1.90821492927058770002e-20), r);
+			const __m256d r2 = _mm256_mul_pd(r, r);
+
+			__m256d ps = _mm256_set1_pd(1.58962301576546568060e-10);
+			ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(-2.50507477628578072866e-8));
+			ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(2.75573136213857245213e-6));
+			ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(-1.98412698295895385996e-4));
+			ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(8.33333333332211858878e-3));
+			ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(-1.66666666666666307295e-1));
+			ps = _mm256_fmadd_pd(_mm256_mul_pd(ps, r2), r, r);
+
+			__m256d pc = _mm256_set1_pd(-1.13585365213876817300e-11);
+			pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(2.08757008419747316778e-9));
+			pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(-2.75573141792967388112e-7));
+			pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(2.48015872888517045348e-5));
+			pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(-1.38888888888730564116e-3));
+			pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(4.16666666666665929218e-2));
+			pc = _mm256_fmadd_pd(_mm256_mul_pd(pc, r2), r2, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), r2, _mm256_set1_pd(1)));
+
+			// Quadrant: swap on odd k, negate sin on k & 2, cos on (k + 1) & 2
+			const __m128i q = _mm256_cvtpd_epi32(k);
+			const __m256i q64 = _mm256_cvtepi32_epi64(q);
+			const __m256d odd = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q64, _mm256_set1_epi64x(1)), _mm256_set1_epi64x(1)));
+			const __m256d signS = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(q64, _mm256_set1_epi64x(2)), 62));
+			const __m256d signC = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(q64, _mm256_set1_epi64x(1)), _mm256_set1_epi64x(2)), 62));
+			s = _mm256_xor_pd(_mm256_blendv_pd(ps, pc, odd), signS);
+			c = _mm256_xor_pd(_mm256_blendv_pd(pc, ps, odd), signC);
+		}
+		MATH_AVX2_END
+
+		MATH_TARGET_AVX2 inline void solveAvx2(const double* M, const double* e, size_t eStride,
+			double* E, double* sinE, double* cosE, size_t count)
+		{
+			const __m256d twoPi = _mm256_set1_pd(kTwoPi);
+			const __m256d signMask = _mm256_set1_pd(-0.0);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m256d vM = _mm256_loadu_pd(M + i);
+				const __m256d ve = eStride ? _mm256_loadu_pd(e + i) : _mm256_set1_pd(e[0]);
+				const __m256d turns = _mm256_round_pd(_mm256_mul_pd(vM, _mm256_set1_pd(1 / kTwoPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+				const __m256d m = _mm256_fnmadd_pd(turns, twoPi, vM);
+
+				// Danby's starter, m + 0.85 e sign(m)
+				const __m256d step = _mm256_or_pd(_mm256_mul_pd(_mm256_set1_pd(0.85), ve), _mm256_and_pd(m, signMask));
+				__m256d vE = _mm256_add_pd(m, step);
+				__m256d s, c, d;
+				for (int it = 0; it < kMaxIterations; ++it)
+				{
+					sincos4(vE, s, c);
+					const __m256d f = _mm256_sub_pd(_mm256_fnmadd_pd(ve, s, vE), m);
+					const __m256d fp = _mm256_fnmadd_pd(ve, c, _mm256_set1_pd(1));
+					const __m256d fpp = _mm256_mul_pd(ve, s);
+					const __m256d den = _mm256_fnmadd_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), f), fpp, _mm256_mul_pd(fp, fp));
+					d = _mm256_div_pd(_mm256_mul_pd(f, fp), den);
+					vE = _mm256_sub_pd(vE, d);
+					const __m256d big = _mm256_cmp_pd(_mm256_andnot_pd(signMask, d), _mm256_set1_pd(kStepTolerance), _CMP_GT_OQ);
+					if (_mm256_movemask_pd(big) == 0)
+						break;
+				}
+				// d was subtracted here. Bring sin and cos along with it
+				const __m256d halfD2 = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(d, d));
+				const __m256d s1 = _mm256_fnmadd_pd(s, halfD2, _mm256_fnmadd_pd(c, d, s));
+				const __m256d c1 = _mm256_fnmadd_pd(c, halfD2, _mm256_fmadd_pd(s, d, c));
+
+				_mm256_storeu_pd(E + i, _mm256_fmadd_pd(turns, twoPi, vE));
+				if (sinE) _mm256_storeu_pd(sinE + i, s1);
+				if (cosE) _mm256_storeu_pd(cosE + i, c1);
+			}
+			solveScalar(M + i, e + i * eStride, eStride, E + i, sinE ? sinE + i : nullptr, cosE ? cosE + i : nullptr, count - i);
+		}
+	}
+
+	// Eccentric anomalies of count elliptic orbits, each with its own eccentricity
+	inline void eccentricAnomaly(const double* M, const double* e, double* E, double* sinE, double* cosE, size_t count)
+	{
+		static const detail::KeplerKernel kernel = math::pickKernel<detail::KeplerKernel>(detail::solveScalar, nullptr, detail::solveAvx2);
+		kernel(M, e, 1, E, sinE, cosE, count);
+	}
+
+	// Eccentric anomalies at count times of a single orbit
+	inline void eccentricAnomaly(const double* M, double e, double* E, double* sinE, double* cosE, size_t count)
+	{
+		static const detail::KeplerKernel kernel = math::pickKernel<detail::KeplerKernel>(detail::solveScalar, nullptr, detail::solveAvx2);
+		kernel(M, &e, 0, E, sinE, cosE, count);
+	}
+}	// namespace kepler
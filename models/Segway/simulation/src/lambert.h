@@ -0,0 +1,155 @@
+#pragma once
+// Lambert's problem: the conic joining two positions in a given time of flight.
+// Follows Izzo's formulation (Revisiting Lambert's problem, 2015): the time of flight is written
+// as a function of a single variable x, the starter comes from its asymptotes, and Householder
+// iterations (third order) refine it. Converges in 2 or 3 iterations for almost any geometry.
+// Only zero revolution, prograde transfers, in the ecliptic plane like the rest of orbits.h.
+
+#include <cmath>
+#include <math/vector.h>
+
+namespace lambert
+{
+	struct Solution
+	{
+		math::Vec2d v1; // Velocity leaving r1
+		math::Vec2d v2; // Velocity arriving at r2
+		int iterations = 0;
+		bool valid = false;
+	};
+
+	namespace detail
+	{
+		constexpr double kTolerance = 1e-11;
+		constexpr int kMaxIterations = 15;
+
+		// Gauss hypergeometric 2F1(3, 1, 5/2, z), for the series close to the parabola
+		inline double hypergeometricF(double z)
+		{
+			double sum = 1, term = 1;
+			for (int j = 0; j < 64 && std::abs(term) > kTolerance; ++j)
+			{
+				term *= (3 + j) * (1 + j) / (2.5 + j) * z / (j + 1);
+				sum += term;
+			}
+			return sum;
+		}
+
+		// Non dimensional time of flight for a given x, with lambda = +-sqrt(1 - c/s)
+		inline double timeOfFlight(double x, double lambda)
+		{
+			const double dist = std::abs(x - 1);
+			if (dist > 0.01 && dist < 0.2)
+			{
+				// Lagrange's expression
+				const double a = 1 / (1 - x * x);
+				if (a > 0)
+				{
+					const double alpha = 2 * std::acos(x);
+					double beta = 2 * std::asin(std::sqrt(lambda * lambda / a));
+					if (lambda < 0)
+						beta = -beta;
+					return a * std::sqrt(a) * ((alpha - std::sin(alpha)) - (beta - std::sin(beta))) / 2;
+				}
+				const double alpha = 2 * std::acosh(x);
+				double beta = 2 * std::asinh(std::sqrt(-lambda * lambda / a));
+				if (lambda < 0)
+					beta = -beta;
+				return -a * std::sqrt(-a) * ((beta - std::sinh(beta)) - (alpha - std::sinh(alpha))) / 2;
+			}
+
+			const double E = x * x - 1;
+			const double z = std::sqrt(1 + lambda * lambda * E);
+			if (dist <= 0.01)
+			{
+				// Battin's series, well conditioned next to the parabola x = 1
+				const double eta = z - lambda * x;
+				const double S1 = 0.5 * (1 - lambda - x * eta);
+				const double Q = 4.0 / 3 * hypergeometricF(S1);
+				return (eta * eta * eta * Q + 4 * lambda * eta) / 2;
+			}
+
+			// Lancaster's expression, elsewhere
+			const double y = std::sqrt(std::abs(E));
+			const double g = x * z - lambda * E;
+			const double d = E < 0 ? std::acos(g) : std::log(y * (z - lambda * x) + g);
+			return (x - lambda * z - d / y) / E;
+		}
+	}
+
+	// Transfer from r1 to r2 in timeOfFlight seconds, around a body with gravitational parameter mu
+	inline Solution solve(const math::Vec2d& r1, const math::Vec2d& r2, double timeOfFlight, double mu)
+	{
+		Solution sol;
+		const double r1n = r1.norm();
+		const double r2n = r2.norm();
+		const double c = (r2 - r1).norm();
+		if (timeOfFlight <= 0 || c == 0)
+			return sol;
+
+		const double s = 0.5 * (r1n + r2n + c);
+		const math::Vec2d ir1 = r1 / r1n;
+		const math::Vec2d ir2 = r2 / r2n;
+		// Transfers through more than half a turn have negative lambda
+		const double crossZ = ir1.x() * ir2.y() - ir1.y() * ir2.x();
+		double lambda = std::sqrt(std::max(0.0, 1 - c / s));
+		if (crossZ < 0)
+			lambda = -lambda;
+		// Tangential directions, for prograde motion
+		const math::Vec2d it1(-ir1.y(), ir1.x());
+		const math::Vec2d it2(-ir2.y(), ir2.x());
+
+		const double T = std::sqrt(2 * mu / (s * s * s)) * timeOfFlight;
+		const double l2 = lambda * lambda;
+		const double l3 = l2 * lambda;
+
+		// Starter from the parabolic (T1) and minimum energy (T0) times of flight
+		const double T0 = std::acos(lambda) + lambda * std::sqrt(1 - l2);
+		const double T1 = 2.0 / 3 * (1 - l3);
+		double x;
+		if (T >= T0)
+			x = std::pow(T0 / T, 2.0 / 3) - 1;
+		else if (T < T1)
+			x = 2.5 * T1 / T * (T1 - T) / (1 - l2 * l3) + 1;
+		else
+			x = std::pow(T0 / T, std::log2(T1 / T0)) - 1;
+
+		// Householder iterations on T(x) - T
+		for (int it = 0; it < detail::kMaxIterations; ++it)
+		{
+			const double tof = detail::timeOfFlight(x, lambda);
+			const double umx2 = 1 - x * x;
+			const double y = std::sqrt(1 - l2 * umx2);
+			const double dT = (3 * tof * x - 2 + 2 * l3 * x / y) / umx2;
+			const double ddT = (3 * tof + 5 * x * dT + 2 * (1 - l2) * l3 / (y * y * y)) / umx2;
+			const double dddT = (7 * x * ddT + 8 * dT - 6 * (1 - l2) * l2 * l3 * x / (y * y * y * y * y)) / umx2;
+
+			const double delta = tof - T;
+			const double dT2 = dT * dT;
+			const double step = delta * (dT2 - delta * ddT / 2) / (dT * (dT2 - delta * ddT) + dddT * delta * delta / 6);
+			x -= step;
+			sol.iterations = it + 1;
+			if (!std::isfinite(x))
+				return sol;
+			if (std::abs(step) < detail::kTolerance)
+			{
+				sol.valid = true;
+				break;
+			}
+		}
+		if (!sol.valid)
+			return sol;
+
+		// Velocities from x
+		const double gamma = std::sqrt(mu * s / 2);
+		const double rho = (r1n - r2n) / c;
+		const double sigma = std::sqrt(std::max(0.0, 1 - rho * rho));
+		const double y = std::sqrt(1 - l2 + l2 * x * x);
+		const double vr1 = gamma * ((lambda * y - x) - rho * (lambda * y + x)) / r1n;
+		const double vr2 = -gamma * ((lambda * y - x) + rho * (lambda * y + x)) / r2n;
+		const double vt = gamma * sigma * (y + lambda * x);
+		sol.v1 = ir1 * vr1 + it1 * (vt / r1n);
+		sol.v2 = ir2 * vr2 + it2 * (vt / r2n);
+		return sol;
+	}
+}	// namespace lambert
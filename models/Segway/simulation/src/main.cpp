@@ -4,15 +4,15 @@
 #include "implot.h"
 #include <cmath>
 #include "app.h"
+#include "physics.h"
+#include "porkchop.h"
 #include <math/vector.h>
 #include <math/matrix.h>
 #include <math/noise.h>
+#include <chrono>
 #include <numbers>
 #include <random>
 
-static constexpr auto Pi = std::numbers::pi_v<double>;
-static constexpr auto TwoPi = 2 * std::numbers::pi_v<double>;
-
 using namespace math;
 
 template<class Derived>
@@ -71,52 +71,53 @@ struct Presentation : Singleton<Presentation>
 private:
     std::vector<RenderShape*> m_Shapes;
 };
-
-struct Circle : RenderShape
+// Draws a circle collider at an interpolated position
+struct CircleShape : RenderShape
 {
-    Circle(const std::string& name, float radius)
+    CircleShape(const std::string& name, const Circle& collider)
         : RenderShape(name)
-        , m_pos{}
-        , m_radius(radius)
+        , m_collider(&collider)
+        , m_pos(collider.m_pos)
     {}
 
     void Render() const override
     {
+        const float radius = m_collider->m_radius;
         float x[kNumSegments + 1];
         float y[kNumSegments + 1];
         for (int i = 0; i < kNumSegments + 1; ++i)
         {
             auto theta = i * TwoPi / kNumSegments;
-            x[i] = m_radius * cos(theta) + m_pos.x();
-            y[i] = m_radius * sin(theta) + m_pos.y();
+            x[i] = radius * cos(theta) + m_pos.x();
+            y[i] = radius * sin(theta) + m_pos.y();
         }
-        ImPlot::SetNextLineStyle(m_Colliding ? kRed : m_Color);
+        ImPlot::SetNextLineStyle(m_collider->m_Colliding ? kRed : m_Color);
         ImPlot::PlotLine(m_name.c_str(), x, y, kNumSegments + 1);
     }
 
     // Params
     ImVec4 m_Color = ImVec4(0.5f, 0.5f, 0.5f, 0.5f);
-    float m_radius;
+    const Circle* m_collider;
 
     // State
     math::Vec2f m_pos;
-    bool m_Colliding = false;
 
     static inline const ImVec4 kRed = ImVec4(1.f, 0.f, 0.f, 1.f);
     static constexpr inline size_t kNumSegments = 32;
 };
 
-struct KinematicAABB : RenderShape
+struct BoxShape : RenderShape
 {
-    KinematicAABB(const std::string& name, const Vec2f& _min, const Vec2f& _max)
+    BoxShape(const std::string& name, const KinematicAABB& box)
         : RenderShape(name)
-        , m_Min(_min)
-        , m_Max(_max)
+        , m_box(&box)
     {
     }
 
     void Render() const override
     {
+        const Vec2f& m_Min = m_box->m_Min;
+        const Vec2f& m_Max = m_box->m_Max;
         float x[5] = { m_Min.x(), m_Min.x(), m_Max.x(), m_Max.x(), m_Min.x() };
         float y[5] = { m_Max.y(), m_Min.y(), m_Min.y(), m_Max.y(), m_Max.y() };
 
@@ -126,34 +127,25 @@ struct KinematicAABB : RenderShape
 
     // Params
     ImVec4 m_Color = ImVec4(0.5f, 0.5f, 0.5f, 0.5f);
-    Vec2f m_Min, m_Max;
+    const KinematicAABB* m_box;
 };
 
-bool intersect(const Circle& a, const Circle& b)
+// Draws the returns of the last scan of a range sensor
+struct ScanShape : RenderShape
 {
-    float R = a.m_radius + b.m_radius;
-    Vec2f relPos = b.m_pos - a.m_pos;
-    return relPos.sqNorm() <= R * R;
-}
+    ScanShape(const std::string& name, const RangeSensor& sensor)
+        : RenderShape(name)
+        , m_sensor(&sensor)
+    {}
 
-bool intersect(const Circle& a, const Vec2f& pos)
-{
-    Vec2f relPos = pos - a.m_pos;
-    return relPos.sqNorm() <= a.m_radius * a.m_radius;
-}
+    void Render() const override
+    {
+        ImPlot::SetNextMarkerStyle(ImPlotMarker_Circle, 1.f);
+        ImPlot::PlotScatter(m_name.c_str(), m_sensor->hitX(), m_sensor->hitY(), m_sensor->numHits());
+    }
 
-bool intersect(const KinematicAABB& aabb, const Circle& c)
-{
-    // Find the point in the AABB closest to the circle
-    auto x = c.m_pos.x();
-    auto y = c.m_pos.y();
-    x = std::min(x, aabb.m_Max.x());
-    y = std::min(y, aabb.m_Max.y());
-    x = std::max(x, aabb.m_Min.x());
-    y = std::max(y, aabb.m_Min.y());
-
-    return intersect(c, Vec2f(x, y));
-}
+    const RangeSensor* m_sensor;
+};
 
 struct RenderLine : RenderShape
 {
@@ -173,301 +165,6 @@ struct RenderLine : RenderShape
 
     math::Vec2f a, b;
 };
-
-struct RigidBody
-{
-    // Parameters
-    float m_InvMass;
-    float m_InvInertia;
-    Vec2f m_CenterOfMass{};
-
-    // State
-    Vec2f m_Position{};
-    Vec2f m_LinearVelocity{};
-    float m_Angle = 0;
-    float m_AngularVelocity = 0;
-
-    // Forces
-    Vec2f m_AccumForces{};
-    float m_AccumTorque{};
-
-    void ResetForces()
-    {
-        m_AccumForces = {};
-        m_AccumTorque = 0;
-    }
-
-    void ApplyForce(const Vec2f& force, const Vec2f& relativePos)
-    {
-        Vec2f arm = relativePos - m_CenterOfMass;
-        float torque = arm.x() * force.y() - force.x() * arm.y();
-        m_AccumForces += force;
-        m_AccumTorque += torque;
-    }
-
-    void ApplyForce(const Vec2f & force)
-    {
-        m_AccumForces += force;
-    }
-
-    void Integrate(float dt)
-    {
-        Vec2f linearAcceleration = m_AccumForces * m_InvMass;
-        float angularAcceleration = m_AccumTorque * m_InvInertia;
-
-        // Basic euler integration
-        m_Position += m_LinearVelocity * dt + 0.5 * linearAcceleration * (dt*dt);
-        m_Angle += m_AngularVelocity * dt + 0.5 * angularAcceleration * (dt*dt);
-        m_LinearVelocity += linearAcceleration * dt;
-        m_AngularVelocity += angularAcceleration * dt;
-    }
-};
-
-struct ForceGenerator
-{
-    virtual void ApplyForces() = 0;
-};
-
-struct Spring : ForceGenerator
-{
-    Spring(RigidBody& a, RigidBody& b, float restLength, float k) // TODO: Support body offsets
-        : m_a(&a)
-        , m_b(&b)
-        , m_restLength(restLength)
-        , m_k(k)
-    {
-    }
-
-    void ApplyForces() override
-    {
-        Vec2f deltaPos = m_b->m_Position - m_a->m_Position;
-        float len = deltaPos.norm();
-        Vec2f F = (len ? ((len - m_restLength)/len * m_k) : 0) * deltaPos;
-        m_b->ApplyForce(-F);
-        m_a->ApplyForce(F);
-    }
-
-    RigidBody* m_a;
-    RigidBody* m_b;
-    float m_restLength;
-    float m_k;
-};
-
-struct Constraint
-{
-    virtual void ApplyConstraintForce() = 0;
-};
-
-struct PivotConstraint : Constraint
-{
-    PivotConstraint(RigidBody& body, const Vec2f& pivotPos, float distance)
-        : m_body(&body)
-        , m_pivotPos(pivotPos)
-        , m_distance(distance)
-    {
-        assert(body.m_InvMass != 0);
-    }
-
-    void ApplyConstraintForce() override
-    {
-        Vec2f relPos = m_body->m_Position - m_pivotPos;
-        Vec2f v = m_body->m_LinearVelocity;
-        float r2 = relPos.sqNorm();
-        float v2 = v.sqNorm();
-        float work = dot(m_body->m_AccumForces, relPos);
-        float invMass = m_body->m_InvMass;
-        float lambda = -(work * invMass + v2) / (r2 * invMass);
-        m_body->ApplyForce(lambda * relPos);
-    }
-
-    RigidBody* m_body;
-    Vec2f m_pivotPos;
-    float m_distance;
-};
-
-struct RigidBodyWorld
-{
-    static inline RigidBodyWorld* sInstance = nullptr;
-    static void Init() {
-        sInstance = new RigidBodyWorld();
-    }
-    static RigidBodyWorld* Get() { return sInstance; }
-
-    void AddRigidBody(RigidBody& body)
-    {
-        m_bodies.push_back(&body);
-    }
-
-    void RemoveRigidBody(RigidBody& body)
-    {
-        for (size_t i = 0; i < m_bodies.size(); ++i)
-        {
-            if (m_bodies[i] == &body)
-            {
-                m_bodies[i] = m_bodies.back();
-                m_bodies.pop_back();
-                return;
-            }
-        }
-    }
-    
-    void AddKinematicBody(KinematicAABB& body)
-    {
-        m_KinematicBodies.push_back(&body);
-    }
-
-    void RemoveKinematicBody(KinematicAABB& body)
-    {
-        for (size_t i = 0; i < m_KinematicBodies.size(); ++i)
-        {
-            if (m_KinematicBodies[i] == &body)
-            {
-                m_KinematicBodies[i] = m_KinematicBodies.back();
-                m_KinematicBodies.pop_back();
-                return;
-            }
-        }
-    }
-
-    void AddCollider(Circle& collider)
-    {
-        m_circleColliders.push_back(&collider);
-    }
-
-    void RemoveCollider(Circle& collider)
-    {
-        for (size_t i = 0; i < m_circleColliders.size(); ++i)
-        {
-            if (m_circleColliders[i] == &collider)
-            {
-                m_circleColliders[i] = m_circleColliders.back();
-                m_circleColliders.pop_back();
-                return;
-            }
-        }
-    }
-
-    void AddForceGenerator(ForceGenerator& generator)
-    {
-        m_ForceGenerators.push_back(&generator);
-    }
-
-    void RemoveForceGenerator(ForceGenerator& generator)
-    {
-        for (size_t i = 0; i < m_ForceGenerators.size(); ++i)
-        {
-            if (m_ForceGenerators[i] == &generator)
-            {
-                m_ForceGenerators[i] = m_ForceGenerators.back();
-                m_ForceGenerators.pop_back();
-                return;
-            }
-        }
-    }
-
-    void AddConstraint(Constraint& constraint)
-    {
-        m_Constraints.push_back(&constraint);
-    }
-
-    void RemoveConstraint(Constraint& constraint)
-    {
-        for (size_t i = 0; i < m_Constraints.size(); ++i)
-        {
-            if (m_Constraints[i] == &constraint)
-            {
-                m_Constraints[i] = m_Constraints.back();
-                m_Constraints.pop_back();
-                return;
-            }
-        }
-    }
-
-    void Update(float dt)
-    {
-        // Update simulation
-        m_stepResidual += dt;
-        while (m_stepResidual > m_fixedStepSize)
-        {
-            m_stepResidual -= m_fixedStepSize;
-            Step();
-        }
-    }
-
-    float m_fixedStepSize = 0.01f;
-
-private:
-    void Step()
-    {
-        // Clear collisions
-        for (auto collider : m_circleColliders)
-        {
-            collider->m_Colliding = false;
-        }
-
-        // Detect collisions
-        for (size_t i = 0; i < m_circleColliders.size(); ++i)
-        {
-            for (size_t j = i + 1; j < m_circleColliders.size(); ++j)
-            {
-                if (intersect(*m_circleColliders[i], *m_circleColliders[j]))
-                {
-                    m_circleColliders[i]->m_Colliding = true;
-                    m_circleColliders[j]->m_Colliding = true;
-                }
-            }
-        }
-        for (size_t i = 0; i < m_circleColliders.size(); ++i)
-        {
-            for (size_t j = 0; j < m_KinematicBodies.size(); ++j)
-            {
-                if (intersect(*m_KinematicBodies[j], *m_circleColliders[i]))
-                {
-                    m_circleColliders[i]->m_Colliding = true;
-                }
-            }
-        }
-
-        // Add gravity to every body
-        for (auto body : m_bodies)
-        {
-            if (body->m_InvMass > 0)
-                body->ApplyForce(Vec2f(0.f, -9.81 / body->m_InvMass));
-        }
-
-        // Apply custom force generators
-        for (auto generator : m_ForceGenerators)
-        {
-            generator->ApplyForces();
-        }
-
-        // Apply constraints force generators
-        for (auto c : m_Constraints)
-        {
-            c->ApplyConstraintForce();
-        }
-
-        // Integrate trajectories
-        for (auto body : m_bodies)
-        {
-            body->Integrate(m_fixedStepSize);
-        }
-
-        // Clear forces
-        for (auto body : m_bodies)
-        {
-            body->ResetForces();
-        }
-    }
-
-    float m_stepResidual = 0;
-    std::vector<RigidBody*> m_bodies;
-    std::vector<Circle*> m_circleColliders;
-    std::vector<KinematicAABB*> m_KinematicBodies;
-    std::vector<ForceGenerator*> m_ForceGenerators;
-    std::vector<Constraint*> m_Constraints;
-};
-
 struct Particle
 {
     Particle(const std::string& name, float mass, float radius, const Vec2f& pos)
@@ -478,23 +175,29 @@ struct Particle
         m_rigidBody->m_InvMass = invMass;
         m_rigidBody->m_InvInertia = invMass; // TODO: Use the correct inertia distribution based on shape and size
         m_rigidBody->m_Position = pos;
+        m_rigidBody->ResetInterpolation();
         RigidBodyWorld::Get()->AddRigidBody(*m_rigidBody);
 
-        m_renderer = std::make_unique<Circle>(name, radius);
+        m_collider = std::make_unique<Circle>(radius);
+        m_collider->m_pos = pos;
+        m_rigidBody->m_Collider = m_collider.get();
+        RigidBodyWorld::Get()->AddCollider(*m_collider);
+
+        m_renderer = std::make_unique<CircleShape>(name, *m_collider);
         Presentation::Get()->AddShape(*m_renderer);
-        RigidBodyWorld::Get()->AddCollider(*m_renderer);
     }
 
     ~Particle()
     {
         RigidBodyWorld::Get()->RemoveRigidBody(*m_rigidBody);
-        RigidBodyWorld::Get()->RemoveCollider(*m_renderer);
+        RigidBodyWorld::Get()->RemoveCollider(*m_collider);
         Presentation::Get()->RemoveShape(*m_renderer);
     }
 
-    void Update()
+    // Blend the last two physics states, so rendering doesn't snap to the physics step
+    void Update(float alpha)
     {
-        m_renderer->m_pos = m_rigidBody->m_Position;
+        m_renderer->m_pos = math::lerp(m_rigidBody->m_PrevPosition, m_rigidBody->m_Position, alpha);
     }
 
     void Render()
@@ -503,25 +206,96 @@ struct Particle
     }
 
     std::unique_ptr<RigidBody> m_rigidBody;
-    std::unique_ptr<Circle> m_renderer;
+    std::unique_ptr<Circle> m_collider;
+    std::unique_ptr<CircleShape> m_renderer;
 };
 
 struct Obstacle
 {
     Obstacle(const std::string& name, const Vec2f& _min, const Vec2f& _max)
     {
-        m_box = std::make_unique<KinematicAABB>(name, _min, _max);
+        m_box = std::make_unique<KinematicAABB>(_min, _max);
         RigidBodyWorld::Get()->AddKinematicBody(*m_box);
-        Presentation::Get()->AddShape(*m_box);
+        m_renderer = std::make_unique<BoxShape>(name, *m_box);
+        Presentation::Get()->AddShape(*m_renderer);
     }
 
     ~Obstacle()
     {
         RigidBodyWorld::Get()->RemoveKinematicBody(*m_box);
-        Presentation::Get()->RemoveShape(*m_box);
+        Presentation::Get()->RemoveShape(*m_renderer);
     }
 
     std::unique_ptr<KinematicAABB> m_box;
+    std::unique_ptr<BoxShape> m_renderer;
+};
+
+// Earth to Mars transfer costs over the 2026 window, computed on demand
+class PorkchopView
+{
+public:
+    void update()
+    {
+        if (ImGui::Begin("Transfers"))
+        {
+            ImGui::SliderInt("Grid size", &m_gridSize, 16, 1000);
+            ImGui::SameLine();
+            if (ImGui::Button("Compute"))
+                compute();
+            ImGui::RadioButton("C3 (km^2/s^2)", &m_field, 0);
+            ImGui::SameLine();
+            ImGui::RadioButton("Arrival v_inf (km/s)", &m_field, 1);
+            ImGui::SliderFloat("Scale max", &m_scaleMax[m_field], 1.f, 100.f);
+
+            if (!m_grid.c3.empty())
+            {
+                ImGui::Text("Solved in %.3f s", m_solveTime);
+                if (ImPlot::BeginPlot("Porkchop", ImVec2(-1, -1)))
+                {
+                    ImPlot::SetupAxes("Departure (days after J2000)", "Arrival (days after J2000)");
+                    const auto& g = m_grid;
+                    const double halfDep = 0.5 * g.departureStep;
+                    const double halfArr = 0.5 * g.arrivalStep;
+                    // Rows go from the earliest arrival, and PlotHeatmap draws the first row on top.
+                    // Swapping the y bounds puts it at the bottom instead.
+                    const ImPlotPoint boundsMin(daysFromSeconds(g.departure(0) - halfDep), daysFromSeconds(g.arrival(g.numArrivals - 1) + halfArr));
+                    const ImPlotPoint boundsMax(daysFromSeconds(g.departure(g.numDepartures - 1) + halfDep), daysFromSeconds(g.arrival(0) - halfArr));
+                    const auto& values = m_field == 0 ? g.c3 : g.arrivalVInf;
+                    ImPlot::PlotHeatmap(m_field == 0 ? "C3" : "v_inf", values.data(), g.numArrivals, g.numDepartures,
+                        0, m_scaleMax[m_field], nullptr, boundsMin, boundsMax);
+                    ImPlot::EndPlot();
+                }
+            }
+        }
+        ImGui::End();
+    }
+
+private:
+    void compute()
+    {
+        const double depStart = secondsSinceJ2000(sys_days(2026y / September / 1));
+        const double depEnd = secondsSinceJ2000(sys_days(2027y / January / 1));
+        const double arrStart = secondsSinceJ2000(sys_days(2027y / May / 1));
+        const double arrEnd = secondsSinceJ2000(sys_days(2028y / March / 1));
+        if (m_earth.empty())
+        {
+            m_earth = ChebyshevEphemeris(EarthOrbit, depStart, arrEnd);
+            m_mars = ChebyshevEphemeris(MarsOrbit, depStart, arrEnd);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        m_grid = computePorkchop(m_earth, m_mars, SolarGravitationalConstant,
+            depStart, depEnd, m_gridSize, arrStart, arrEnd, m_gridSize);
+        m_solveTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ChebyshevEphemeris m_earth;
+    ChebyshevEphemeris m_mars;
+    PorkchopGrid m_grid;
+    int m_gridSize = 300;
+    int m_field = 0;
+    float m_scaleMax[2] = { 30.f, 10.f };
+    float m_solveTime = 0;
 };
 
 class SegwayApp : public App
@@ -548,6 +322,17 @@ public:
         RigidBodyWorld::Get()->AddForceGenerator(*m_Spring);
 
         m_Obstacles.push_back(std::make_unique<Obstacle>("ground", Vec2f(-6.f, -8.f), Vec2f(6.f, -7.f)));
+
+        m_Lidar = std::make_unique<RangeSensor>(*m_Particles[2]->m_rigidBody, 1080, float(TwoPi), 30.f, 40.f);
+        RigidBodyWorld::Get()->AddSensor(*m_Lidar);
+        m_LidarRenderer = std::make_unique<ScanShape>("lidar", *m_Lidar);
+        Presentation::Get()->AddShape(*m_LidarRenderer);
+    }
+
+    ~SegwayApp()
+    {
+        RigidBodyWorld::Get()->RemoveSensor(*m_Lidar);
+        Presentation::Get()->RemoveShape(*m_LidarRenderer);
     }
 
     void resetSimulation()
@@ -558,6 +343,7 @@ public:
         {
             p->m_rigidBody->m_LinearVelocity = {};
             p->m_rigidBody->m_Position = Vec2f(m_rng.uniform(a, b), m_rng.uniform(a, b));
+            p->m_rigidBody->ResetInterpolation();
         }
     }
 
@@ -571,17 +357,23 @@ public:
             {
                 resetSimulation();
             }
+            ImGui::Text("Dropped time: %.3f s", RigidBodyWorld::Get()->TotalDroppedTime());
         }
 
-        const float dt = m_RunningSim ? 0.01666f : 0; // TODO: Get this from std::chrono
+        // Measure real frame time
+        const auto now = std::chrono::steady_clock::now();
+        const float frameTime = std::chrono::duration<float>(now - m_lastFrameTime).count();
+        m_lastFrameTime = now;
+        const float dt = m_RunningSim ? frameTime : 0;
 
         // Advance physics simulation
         RigidBodyWorld::Get()->Update(dt);
 
         // Update renderers
+        const float alpha = RigidBodyWorld::Get()->InterpolationAlpha();
         for (auto& p : m_Particles)
         {
-            p->Update();
+            p->Update(alpha);
         }
 
         // Display results
@@ -594,15 +386,21 @@ public:
             ImPlot::EndPlot();
         }
         ImGui::End();
+
+        m_Porkchop.update();
     }
 
 private:
     bool m_RunningSim = false;
+    std::chrono::steady_clock::time_point m_lastFrameTime = std::chrono::steady_clock::now();
     SquirrelRng m_rng;
     std::unique_ptr<Spring> m_Spring;
+    std::unique_ptr<RangeSensor> m_Lidar;
+    std::unique_ptr<ScanShape> m_LidarRenderer;
     std::vector<std::unique_ptr<Particle>> m_Particles;
     std::vector<std::unique_ptr<Obstacle>> m_Obstacles;
     std::vector<std::unique_ptr<Constraint>> m_Constraints;
+    PorkchopView m_Porkchop;
 };
 
 // Main code
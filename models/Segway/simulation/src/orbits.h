@@ -1,9 +1,12 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <numbers>
 #include <math/vector.h>
 #include <chrono>
+#include <vector>
+#include "kepler.h"
 
 using namespace std::chrono;
 using namespace std::chrono_literals;
@@ -69,6 +72,35 @@ inline double daysFromSeconds(double seconds)
 	return seconds / (24 * 3600);
 }
 
+inline double secondsSinceJ2000(TimePoint time)
+{
+	return duration_cast<duration<double, seconds::period>>(time - J2000).count();
+}
+
+// Closed orbit polyline for drawing, in meters. Callers own it and pass it back to the orbit's
+// plot(maxError, line) every frame, which only rebuilds it when the tolerance changes enough.
+// Orbits hold no drawing state, so threads can plot the same orbit, each into its own polyline.
+struct OrbitPolyline
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	double tolerance = 0; // Max distance between a segment and the orbit. 0 until built.
+
+	// A polyline built for a finer tolerance is reused, until it is more than twice as fine as asked
+	bool matches(double maxError) const
+	{
+		return tolerance > 0 && tolerance <= maxError && 2 * tolerance > maxError;
+	}
+
+	// Tolerance to build for. Halfway between the bounds of matches(), in ratio, so the polyline is
+	// reused while zooming in or out by up to sqrt(2).
+	static double toleranceFor(double maxError) { return maxError / std::numbers::sqrt2; }
+
+	int size() const { return int(x.size()); }
+
+	static constexpr int kMaxPoints = 1 << 16;
+};
+
 class CircularOrbit
 {
 public:
@@ -113,6 +145,37 @@ public:
 		y[numSegments] = y[0];
 	}
 
+	// Updates line to stay within maxError meters of the orbit, e.g. half a pixel in meters. Rebuilt
+	// once per zoom level: a sagitta of t allows a constant step of sqrt(8 t / radius).
+	// A line must only be plotted from one orbit.
+	void plot(double maxError, OrbitPolyline& line) const
+	{
+		if (line.matches(maxError))
+			return;
+
+		const double tolerance = OrbitPolyline::toleranceFor(maxError);
+		const double step = sqrt(8 * tolerance / m_radius);
+		const int numSegments = std::clamp(int(std::ceil(TwoPi / step)), 16, OrbitPolyline::kMaxPoints);
+		line.x.resize(numSegments + 1);
+		line.y.resize(numSegments + 1);
+		line.tolerance = tolerance;
+
+		// Rotate the first point, instead of a sin and cos per point
+		const double c = cos(TwoPi / numSegments);
+		const double s = sin(TwoPi / numSegments);
+		double px = m_radius, py = 0;
+		for (int i = 0; i < numSegments; ++i)
+		{
+			line.x[i] = float(px);
+			line.y[i] = float(py);
+			const double nx = px * c - py * s;
+			py = px * s + py * c;
+			px = nx;
+		}
+		line.x[numSegments] = line.x[0];
+		line.y[numSegments] = line.y[0];
+	}
+
 private:
 	double m_mu; // Gravitational constant
 	double m_radius;
@@ -141,6 +204,8 @@ public:
 		m_eccentricity = (m_apoapsis - m_periapsis) / (m_apoapsis + m_periapsis);
 		m_p = m_periapsis * (1 + m_eccentricity);
 		m_meanAnomalyAtEpoch = meanLongitudeAtEpoch - longitudeOfAscendingNode - argumentOfPeriapsis;
+		const auto a = std::abs(semiMajorAxis());
+		m_meanMotion = sqrt(m_mu / (a * a * a));
 	}
 
 	ConicOrbit(const ConicOrbit&) = default;
@@ -148,7 +213,7 @@ public:
 
 	double radius(double anomaly) const
 	{
-		return m_p / (1 + m_eccentricity * cos(anomaly - m_argumentOfPeriapsis));
+		return m_p / (1 + m_eccentricity * cos(anomaly - longitudeOfPeriapsis()));
 	}
 
 	double speed(double anomaly) const
@@ -184,6 +249,13 @@ public:
 		return m_eccentricity;
 	}
 
+	// Direction of the periapsis from the reference direction. With every orbit in the ecliptic,
+	// that is the longitude of the ascending node plus the argument of periapsis.
+	constexpr double longitudeOfPeriapsis() const
+	{
+		return m_longitudeOfAscendingNode + m_argumentOfPeriapsis;
+	}
+
 	constexpr static double meanRadius(double perihelion, double eccentricity)
 	{
 		return perihelion * (1 + eccentricity);
@@ -209,33 +281,72 @@ public:
 		}
 	}
 
+	// Updates line to stay within maxError meters of the orbit, e.g. half a pixel in meters. Rebuilt
+	// once per zoom level. Steps in eccentric anomaly follow the curvature: a chord of length l has
+	// a sagitta of l^2 k / 8, so steps are short around periapsis and long around apoapsis.
+	// A line must only be plotted from one orbit.
+	void plot(double maxError, OrbitPolyline& line) const
+	{
+		assert(isElliptical()); // Plotting open trajectories is not supported.
+		if (line.matches(maxError))
+			return;
+
+		const double e = m_eccentricity;
+		const double a = semiMajorAxis();
+		const double b = a * sqrt(1 - e * e);
+		const double cosW = cos(longitudeOfPeriapsis());
+		const double sinW = sin(longitudeOfPeriapsis());
+		const double minStep = TwoPi / OrbitPolyline::kMaxPoints;
+		const double tolerance = OrbitPolyline::toleranceFor(maxError);
+
+		// Speed along E is w = sqrt(a^2 sin^2 E + b^2 cos^2 E) and curvature k = ab / w^3,
+		// so the step in E is sqrt(8 tolerance / k) / w
+		const auto stepAt = [&](double E) {
+			const double sinE = sin(E), cosE = cos(E);
+			const double w = sqrt(a * a * sinE * sinE + b * b * cosE * cosE);
+			return std::clamp(sqrt(8 * tolerance * w / (a * b)), minStep, Pi / 8);
+		};
+
+		line.x.clear();
+		line.y.clear();
+		line.tolerance = tolerance;
+		for (double E = 0; E < TwoPi;)
+		{
+			const double px = a * (cos(E) - e);
+			const double py = b * sin(E);
+			line.x.push_back(float(px * cosW - py * sinW));
+			line.y.push_back(float(px * sinW + py * cosW));
+
+			// Curvature grows towards periapsis, so check the step from its far end too
+			const double step = stepAt(E);
+			E += std::min(step, stepAt(E + step));
+		}
+		line.x.push_back(line.x[0]);
+		line.y.push_back(line.y[0]);
+	}
+
 	constexpr bool isElliptical() const { return m_eccentricity < 1; }
 	constexpr bool isParabolical() const { return m_eccentricity == 1; }
 	constexpr bool isHyperbolical() const { return m_eccentricity > 1; }
 
-	double TrueAnomalyFromMeanAnomaly(double meanAnomaly)
+	double TrueAnomalyFromMeanLongitude(double meanLongitude, double longitudeOfPeriapsis) const
 	{
-		const double timeSincePeriapsis = meanAnomaly * period() / TwoPi;
+		// Mean anomaly is the mean longitude measured from the periapsis
+		return TrueAnomalyFromMeanAnomaly(meanLongitude - longitudeOfPeriapsis);
 	}
 
-	double TrueAnomalyFromMeanLongitude(double meanLongitude, double longitudeOfPeriapsis)
+	double MeanAnomaly(TimePoint time) const
 	{
-		const double meanLongitudeSinceAscendingNode = meanLongitude - longitudeOfPeriapsis;
-		const double meanAnomalySinceAscendingNode = meanLongitudeSinceAscendingNode; // "Time" since last periapsis at epoch
+		return MeanAnomaly(secondsSinceJ2000(time));
 	}
 
-	double MeanAnomaly(TimePoint time) const
+	// In [0, 2pi), also for times before the epoch
+	double MeanAnomaly(double timeSinceEpoch) const
 	{
-		assert(time >= J2000);
-
-		// Time since epoch
-		const auto timeSinceEpoch = duration_cast<duration<double, seconds::period>>(time - J2000).count();
-		const auto numOrbits = timeSinceEpoch / period() + m_meanAnomalyAtEpoch / TwoPi + 1; // Make sure we're positive
+		const auto numOrbits = (timeSinceEpoch * m_meanMotion + m_meanAnomalyAtEpoch) * (1 / TwoPi);
 
 		// Time since the start of last orbit
-		const auto meanAnomaly = TwoPi * (numOrbits - std::floor(numOrbits));
-
-		return meanAnomaly;
+		return TwoPi * (numOrbits - std::floor(numOrbits));
 	}
 
 	double TrueAnomaly(TimePoint time) const
@@ -245,22 +356,49 @@ public:
 		return TrueAnomalyFromMeanAnomaly(meanAnomaly);
 	}
 
+	// Exact for any eccentricity. See kepler.h
 	double TrueAnomalyFromMeanAnomaly(double M) const
 	{
-		assert(M >= -Pi && M <= TwoPi);
+		return kepler::trueAnomaly(M, m_eccentricity);
+	}
 
-		// Center anomaly range around 0 to leverage symmetry
-		if (M >= Pi)
-			M -= TwoPi;
+	// Position at a time given in seconds since J2000, in the same frame as position()
+	math::Vec2d positionAt(double timeSinceEpoch) const
+	{
+		const auto trueAnomaly = TrueAnomalyFromMeanAnomaly(MeanAnomaly(timeSinceEpoch));
+		return position(trueAnomaly + longitudeOfPeriapsis());
+	}
 
-		// Using a fourier expansion (should only be used with small eccentricities).
-		const double e = m_eccentricity;
-		const double e2 = e * e;
-		const double e3 = e2 * e;
-		return M + (2 * e + e3 / 4) * sin(M) + 5 * e2 / 4 * sin(2 * M) + 13 * e3 / 12 * sin(3 * M);
+	// Velocity at a time given in seconds since J2000, in the same frame as position()
+	math::Vec2d velocityAt(double timeSinceEpoch) const
+	{
+		const auto trueAnomaly = TrueAnomalyFromMeanAnomaly(MeanAnomaly(timeSinceEpoch));
+		const auto k = sqrt(m_mu / m_p);
+		const auto radial = k * m_eccentricity * sin(trueAnomaly);
+		const auto tangential = k * (1 + m_eccentricity * cos(trueAnomaly));
+		const auto argument = trueAnomaly + longitudeOfPeriapsis();
+		return { radial * cos(argument) - tangential * sin(argument), radial * sin(argument) + tangential * cos(argument) };
+	}
 
-		// Note: If higher precision is needed for highly elliptic orbits, we can either implement
-		// the newton-raphson method or generate a lookup table of eccentric anomalies for binary search.
+	// Positions at count mean anomalies, in the same frame as position(). Elliptic orbits only.
+	void positions(const double* meanAnomaly, double* x, double* y, double* eccentricAnomaly, size_t count) const
+	{
+		assert(isElliptical());
+		const double e = m_eccentricity;
+		const double a = semiMajorAxis();
+		const double b = a * sqrt(1 - e * e);
+		const double cosW = cos(longitudeOfPeriapsis());
+		const double sinW = sin(longitudeOfPeriapsis());
+
+		// x and y hold the cosines and sines of E until they're turned into positions
+		kepler::eccentricAnomaly(meanAnomaly, e, eccentricAnomaly, y, x, count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const double px = a * (x[i] - e);
+			const double py = b * y[i];
+			x[i] = px * cosW - py * sinW;
+			y[i] = px * sinW + py * cosW;
+		}
 	}
 
 private:
@@ -272,6 +410,7 @@ private:
 
 	// Precomputed
 	double m_meanAnomalyAtEpoch = 0;
+	double m_meanMotion = 1; // Radians per second
 
 	// Constants
 	double m_mu = 1;
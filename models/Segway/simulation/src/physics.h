@@ -0,0 +1,940 @@
+// Rigid body simulation for the Segway playground.
+// Kept free of any rendering code, so it can also run headless (see bench/).
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include <math/aabb.h>
+#include <math/bvh.h>
+#include <math/linear.h>
+#include <math/noise.h>
+#include <math/ray.h>
+#include <math/simd.h>
+#include <math/vector.h>
+#include <math/vectorFloat.h>
+
+using math::Vec2f;
+using math::Vec3f;
+
+struct Circle
+{
+    Circle(float radius)
+        : m_radius(radius)
+        , m_pos{}
+    {}
+
+    // Params
+    float m_radius;
+
+    // State
+    math::Vec2f m_pos;
+    bool m_Colliding = false;
+};
+
+struct KinematicAABB
+{
+    KinematicAABB(const Vec2f& _min, const Vec2f& _max)
+        : m_Min(_min)
+        , m_Max(_max)
+    {
+    }
+
+    Vec2f m_Min, m_Max;
+};
+
+inline bool intersect(const Circle& a, const Circle& b)
+{
+    float R = a.m_radius + b.m_radius;
+    Vec2f relPos = b.m_pos - a.m_pos;
+    return relPos.sqNorm() <= R * R;
+}
+
+inline bool intersect(const Circle& a, const Vec2f& pos)
+{
+    Vec2f relPos = pos - a.m_pos;
+    return relPos.sqNorm() <= a.m_radius * a.m_radius;
+}
+
+inline bool intersect(const KinematicAABB& aabb, const Circle& c)
+{
+    // Find the point in the AABB closest to the circle
+    auto x = c.m_pos.x();
+    auto y = c.m_pos.y();
+    x = std::min(x, aabb.m_Max.x());
+    y = std::min(y, aabb.m_Max.y());
+    x = std::max(x, aabb.m_Min.x());
+    y = std::max(y, aabb.m_Min.y());
+
+    return intersect(c, Vec2f(x, y));
+}
+
+// Time of impact of a circle of radius r moving from pos to pos + displacement against a static circle.
+// toi is returned as a fraction of the displacement in [0,1], and normal points from the target towards the moving circle.
+inline bool sweep(const Vec2f& pos, float r, const Vec2f& displacement, const Vec2f& center, float targetRadius, float& toi, Vec2f& normal)
+{
+    float R = r + targetRadius;
+    Vec2f relPos = pos - center;
+    float c = relPos.sqNorm() - R * R;
+    if (c <= 0) // Already overlapping. Leave that to discrete detection.
+        return false;
+    float a = displacement.sqNorm();
+    float b = dot(relPos, displacement);
+    if (b >= 0 || a == 0) // Moving away
+        return false;
+    float disc = b * b - a * c;
+    if (disc < 0)
+        return false;
+    float t = (-b - std::sqrt(disc)) / a;
+    if (t > 1)
+        return false;
+    toi = t;
+    normal = (relPos + t * displacement) / R;
+    return true;
+}
+
+inline bool sweep(const Vec2f& pos, float r, const Vec2f& displacement, const Circle& target, float& toi, Vec2f& normal)
+{
+    return sweep(pos, r, displacement, target.m_pos, target.m_radius, toi, normal);
+}
+
+// Time of impact of a moving circle against a kinematic box.
+// Uses the ray slab test against the box inflated by the radius, then refines hits in the rounded corners.
+inline bool sweep(const Vec2f& pos, float r, const Vec2f& displacement, const KinematicAABB& aabb, float& toi, Vec2f& normal)
+{
+    // Extrude the problem along z so we can reuse the 3d slab test. The ray never moves in z.
+    const math::AABB inflated(
+        Vec3f(aabb.m_Min.x() - r, aabb.m_Min.y() - r, -1.f),
+        Vec3f(aabb.m_Max.x() + r, aabb.m_Max.y() + r, 1.f));
+    const math::Ray ray(Vec3f(pos.x(), pos.y(), 0.f), Vec3f(displacement.x(), displacement.y(), 0.f));
+
+    float tEnter;
+    if (!inflated.intersect(ray.implicit(), 0.f, 1.f, tEnter))
+        return false;
+    if (tEnter <= 0)
+    {
+        // Starting inside the inflated box only means we already overlap outside of its corners.
+        // In a corner square but outside the rounded corner, the corner is the first thing to hit.
+        const bool startInCorner = (pos.x() < aabb.m_Min.x() || pos.x() > aabb.m_Max.x())
+            && (pos.y() < aabb.m_Min.y() || pos.y() > aabb.m_Max.y());
+        if (!startInCorner)
+            return false;
+        const Vec2f corner(
+            std::max(aabb.m_Min.x(), std::min(pos.x(), aabb.m_Max.x())),
+            std::max(aabb.m_Min.y(), std::min(pos.y(), aabb.m_Max.y())));
+        return sweep(pos, r, displacement, corner, 0.f, toi, normal); // Also rejects overlaps
+    }
+
+    Vec2f hit = pos + tEnter * displacement;
+    Vec2f closest(
+        std::max(aabb.m_Min.x(), std::min(hit.x(), aabb.m_Max.x())),
+        std::max(aabb.m_Min.y(), std::min(hit.y(), aabb.m_Max.y())));
+    bool inCorner = (hit.x() < aabb.m_Min.x() || hit.x() > aabb.m_Max.x())
+        && (hit.y() < aabb.m_Min.y() || hit.y() > aabb.m_Max.y());
+    if (inCorner)
+    {
+        // The inflated box overestimates the corners. Sweep against the corner itself instead.
+        return sweep(pos, r, displacement, closest, 0.f, toi, normal);
+    }
+
+    toi = tEnter;
+    normal = (hit - closest) / r;
+    return true;
+}
+//----------------------------------------------------------------------------------------------
+// Ray fan vs circle kernels.
+// Shortens ranges[i] to the first hit of ray i against one circle. Directions must be unit length,
+// rel is the ray origin relative to the circle center, and c = |rel|^2 - r^2 must be positive.
+// One version per instruction set; RigidBodyWorld::CastRays picks the widest one the CPU runs.
+using RayCircleKernel = void (*)(float relX, float relY, float c, const float* dirX, const float* dirY, int numRays, float* ranges);
+
+inline void rayCircleScalar(float relX, float relY, float c, const float* dirX, const float* dirY, int numRays, float* ranges)
+{
+    for (int i = 0; i < numRays; ++i)
+    {
+        // t^2 + 2bt + c = 0
+        float b = dirX[i] * relX + dirY[i] * relY;
+        float disc = b * b - c;
+        if (disc < 0 || b >= 0)
+            continue;
+        float t = -b - std::sqrt(disc);
+        if (t < ranges[i])
+            ranges[i] = t;
+    }
+}
+
+inline void rayCircleSse2(float relX, float relY, float c, const float* dirX, const float* dirY, int numRays, float* ranges)
+{
+    const math::float4 relX4(relX), relY4(relY), c4(c), zero(0.f);
+    const int numPackets = numRays / 4;
+    for (int p = 0; p < numPackets; ++p)
+    {
+        const int i = 4 * p;
+        math::float4 dx(_mm_loadu_ps(dirX + i));
+        math::float4 dy(_mm_loadu_ps(dirY + i));
+        math::float4 b = dx * relX4 + dy * relY4;
+        math::float4 disc = b * b - c4;
+        math::float4 facing = (disc >= zero) & (b < zero);
+        if (!facing.mask())
+            continue;
+        math::float4 range(_mm_loadu_ps(ranges + i));
+        math::float4 t = zero - b - math::float4(_mm_sqrt_ps(disc.m));
+        range = math::select(facing & (t < range), t, range);
+        _mm_storeu_ps(ranges + i, range.m);
+    }
+    const int done = 4 * numPackets;
+    rayCircleScalar(relX, relY, c, dirX + done, dirY + done, numRays - done, ranges + done);
+}
+
+MATH_TARGET_AVX2 inline void rayCircleAvx2(float relX, float relY, float c, const float* dirX, const float* dirY, int numRays, float* ranges)
+{
+    const math::float8 relX8(relX), relY8(relY), c8(c), zero(0.f);
+    const int numPackets = numRays / 8;
+    for (int p = 0; p < numPackets; ++p)
+    {
+        const int i = 8 * p;
+        math::float8 b = math::float8::loadu(dirX + i).mul_add(relX8, math::float8::loadu(dirY + i) * relY8);
+        math::float8 disc = b.mul_add(b, -c8);
+        math::mask8 facing = (disc >= zero) & (b < zero);
+        if (facing.none())
+            continue;
+        math::float8 range = math::float8::loadu(ranges + i);
+        math::float8 t = -b - sqrt(disc);
+        math::select(facing & (t < range), t, range).storeu(ranges + i);
+    }
+    const int done = 8 * numPackets;
+    rayCircleScalar(relX, relY, c, dirX + done, dirY + done, numRays - done, ranges + done);
+}
+
+MATH_TARGET_AVX512 inline void rayCircleAvx512(float relX, float relY, float c, const float* dirX, const float* dirY, int numRays, float* ranges)
+{
+    const __m512 relX16 = _mm512_set1_ps(relX), relY16 = _mm512_set1_ps(relY), c16 = _mm512_set1_ps(c), zero = _mm512_setzero_ps();
+    const int numPackets = numRays / 16;
+    for (int p = 0; p < numPackets; ++p)
+    {
+        const int i = 16 * p;
+        __m512 b = _mm512_fmadd_ps(_mm512_loadu_ps(dirX + i), relX16, _mm512_mul_ps(_mm512_loadu_ps(dirY + i), relY16));
+        __m512 disc = _mm512_fmsub_ps(b, b, c16);
+        __mmask16 facing = _mm512_cmp_ps_mask(disc, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(b, zero, _CMP_LT_OQ);
+        if (!facing)
+            continue;
+        __m512 range = _mm512_loadu_ps(ranges + i);
+        __m512 t = _mm512_sub_ps(_mm512_sub_ps(zero, b), _mm512_maskz_sqrt_ps(facing, disc));
+        __mmask16 closer = _mm512_mask_cmp_ps_mask(facing, t, range, _CMP_LT_OQ);
+        _mm512_mask_storeu_ps(ranges + i, closer, t);
+    }
+    const int done = 16 * numPackets;
+    rayCircleScalar(relX, relY, c, dirX + done, dirY + done, numRays - done, ranges + done);
+}
+
+struct RigidBody
+{
+    // Parameters
+    float m_InvMass;
+    float m_InvInertia;
+    Vec2f m_CenterOfMass{};
+    Circle* m_Collider = nullptr; // Optional. Used for continuous collision detection
+
+    // State
+    Vec2f m_Position{};
+    Vec2f m_LinearVelocity{};
+    float m_Angle = 0;
+    float m_AngularVelocity = 0;
+
+    // State at the start of the last step, for render interpolation
+    Vec2f m_PrevPosition{};
+    float m_PrevAngle = 0;
+
+    // Forces
+    Vec2f m_AccumForces{};
+    float m_AccumTorque{};
+
+    void ResetForces()
+    {
+        m_AccumForces = {};
+        m_AccumTorque = 0;
+    }
+
+    void ApplyForce(const Vec2f& force, const Vec2f& relativePos)
+    {
+        Vec2f arm = relativePos - m_CenterOfMass;
+        float torque = arm.x() * force.y() - force.x() * arm.y();
+        m_AccumForces += force;
+        m_AccumTorque += torque;
+    }
+
+    void ApplyForce(const Vec2f & force)
+    {
+        m_AccumForces += force;
+    }
+
+    // Make the current state the interpolation start, e.g. after teleporting the body
+    void ResetInterpolation()
+    {
+        m_PrevPosition = m_Position;
+        m_PrevAngle = m_Angle;
+    }
+
+    void Integrate(float dt)
+    {
+        Vec2f linearAcceleration = m_AccumForces * m_InvMass;
+        float angularAcceleration = m_AccumTorque * m_InvInertia;
+
+        // Basic euler integration
+        m_Position += m_LinearVelocity * dt + 0.5 * linearAcceleration * (dt*dt);
+        m_Angle += m_AngularVelocity * dt + 0.5 * angularAcceleration * (dt*dt);
+        m_LinearVelocity += linearAcceleration * dt;
+        m_AngularVelocity += angularAcceleration * dt;
+    }
+};
+
+struct ForceGenerator
+{
+    virtual void ApplyForces() = 0;
+};
+
+struct Spring : ForceGenerator
+{
+    Spring(RigidBody& a, RigidBody& b, float restLength, float k) // TODO: Support body offsets
+        : m_a(&a)
+        , m_b(&b)
+        , m_restLength(restLength)
+        , m_k(k)
+    {
+    }
+
+    void ApplyForces() override
+    {
+        Vec2f deltaPos = m_b->m_Position - m_a->m_Position;
+        float len = deltaPos.norm();
+        Vec2f F = (len ? ((len - m_restLength)/len * m_k) : 0) * deltaPos;
+        m_b->ApplyForce(-F);
+        m_a->ApplyForce(F);
+    }
+
+    RigidBody* m_a;
+    RigidBody* m_b;
+    float m_restLength;
+    float m_k;
+};
+
+struct Constraint
+{
+    virtual void ApplyConstraintForce() = 0;
+};
+
+struct PivotConstraint : Constraint
+{
+    PivotConstraint(RigidBody& body, const Vec2f& pivotPos, float distance)
+        : m_body(&body)
+        , m_pivotPos(pivotPos)
+        , m_distance(distance)
+    {
+        assert(body.m_InvMass != 0);
+    }
+
+    void ApplyConstraintForce() override
+    {
+        Vec2f relPos = m_body->m_Position - m_pivotPos;
+        Vec2f v = m_body->m_LinearVelocity;
+        float r2 = relPos.sqNorm();
+        float v2 = v.sqNorm();
+        float work = dot(m_body->m_AccumForces, relPos);
+        float invMass = m_body->m_InvMass;
+        float lambda = -(work * invMass + v2) / (r2 * invMass);
+        m_body->ApplyForce(lambda * relPos);
+    }
+
+    RigidBody* m_body;
+    Vec2f m_pivotPos;
+    float m_distance;
+};
+
+struct RigidBodyWorld;
+
+// Simulated 2d lidar attached to a rigid body.
+// Casts a fan of evenly spaced beams at a fixed rate, and stores the measured ranges in a preallocated buffer.
+struct RangeSensor
+{
+    RangeSensor(RigidBody& body, int numBeams, float fov, float maxRange, float scanRate)
+        : m_body(&body)
+        , m_maxRange(maxRange)
+        , m_scanPeriod(1 / scanRate)
+    {
+        assert(numBeams > 0);
+        // Beam directions are fixed in body space. Precompute them once.
+        m_localDirX.resize(numBeams);
+        m_localDirY.resize(numBeams);
+        const float angleStep = numBeams > 1 ? fov / (numBeams - 1) : 0;
+        for (int i = 0; i < numBeams; ++i)
+        {
+            float angle = -0.5f * fov + i * angleStep;
+            m_localDirX[i] = cos(angle);
+            m_localDirY[i] = sin(angle);
+        }
+        m_dirX.resize(numBeams);
+        m_dirY.resize(numBeams);
+        m_ranges.resize(numBeams, maxRange);
+        m_hitX.resize(numBeams);
+        m_hitY.resize(numBeams);
+    }
+
+    // Advance the sensor clock, scanning if a new scan is due.
+    void Update(const RigidBodyWorld& world, float dt)
+    {
+        m_timeToScan -= dt;
+        if (m_timeToScan <= 0)
+        {
+            m_timeToScan += m_scanPeriod;
+            Scan(world);
+        }
+    }
+
+    void Scan(const RigidBodyWorld& world);
+
+    int numBeams() const { return int(m_ranges.size()); }
+    const float* ranges() const { return m_ranges.data(); }
+
+    // Hit points of the last scan in world space
+    int numHits() const { return m_numHits; }
+    const float* hitX() const { return m_hitX.data(); }
+    const float* hitY() const { return m_hitY.data(); }
+
+    // Params
+    Vec2f m_mountOffset{}; // In body space
+    float m_mountAngle = 0;
+    float m_rangeNoise = 0.01f; // Standard deviation, in meters
+    float m_dropoutProbability = 0.f; // Chance of a beam not returning
+    int m_seed = 0;
+
+private:
+    // squirrelNoise only takes 32 bit positions. Past them, the high half of the counter perturbs the seed,
+    // so long runs neither overflow nor repeat, and the first 2^31 values are unchanged.
+    static uint32_t noiseBits(uint64_t counter, int seed)
+    {
+        const uint32_t high = uint32_t(counter >> 32);
+        if (high)
+            seed = math::squirrelNoise(int(high), seed);
+        return uint32_t(math::squirrelNoise(int(uint32_t(counter)), seed));
+    }
+
+    float gaussianNoise(uint64_t counter) const
+    {
+        // Box-Muller on two counter based uniform samples, so scans are reproducible
+        constexpr float kInvRange = 1.f / (1 << 24);
+        float u1 = (float(noiseBits(2 * counter, m_seed) & ((1 << 24) - 1)) + 0.5f) * kInvRange;
+        float u2 = float(noiseBits(2 * counter + 1, m_seed) & ((1 << 24) - 1)) * kInvRange;
+        return std::sqrt(-2 * std::log(u1)) * cos(2 * std::numbers::pi_v<float> * u2);
+    }
+
+    float uniformNoise(uint64_t counter) const
+    {
+        return float(noiseBits(counter, m_seed + 1) & ((1 << 24) - 1)) / (1 << 24);
+    }
+
+    RigidBody* m_body;
+    float m_maxRange;
+    float m_scanPeriod;
+    float m_timeToScan = 0;
+    uint64_t m_scanCount = 0;
+
+    std::vector<float> m_localDirX, m_localDirY;
+    std::vector<float> m_dirX, m_dirY;
+    std::vector<float> m_ranges;
+
+    std::vector<float> m_hitX, m_hitY;
+    int m_numHits = 0;
+};
+
+struct RigidBodyWorld
+{
+    // Accumulated wall time spent in each phase of Step, in seconds
+    struct PhaseTimings
+    {
+        double collision = 0;
+        double forces = 0;
+        double constraints = 0;
+        double integration = 0;
+        double sensors = 0;
+        int numSteps = 0;
+    };
+
+    static inline RigidBodyWorld* sInstance = nullptr;
+    static void Init() {
+        sInstance = new RigidBodyWorld();
+    }
+    static RigidBodyWorld* Get() { return sInstance; }
+
+    void AddRigidBody(RigidBody& body)
+    {
+        m_bodies.push_back(&body);
+    }
+
+    void RemoveRigidBody(RigidBody& body)
+    {
+        for (size_t i = 0; i < m_bodies.size(); ++i)
+        {
+            if (m_bodies[i] == &body)
+            {
+                m_bodies[i] = m_bodies.back();
+                m_bodies.pop_back();
+                return;
+            }
+        }
+    }
+    
+    void AddKinematicBody(KinematicAABB& body)
+    {
+        m_KinematicBodies.push_back(&body);
+        m_KinematicBvhDirty = true;
+    }
+
+    void RemoveKinematicBody(KinematicAABB& body)
+    {
+        for (size_t i = 0; i < m_KinematicBodies.size(); ++i)
+        {
+            if (m_KinematicBodies[i] == &body)
+            {
+                m_KinematicBodies[i] = m_KinematicBodies.back();
+                m_KinematicBodies.pop_back();
+                m_KinematicBvhDirty = true;
+                return;
+            }
+        }
+    }
+
+    // Kinematic bodies are assumed static. Call this after moving any of them.
+    void OnKinematicBodyMoved()
+    {
+        m_KinematicBvhDirty = true;
+    }
+
+    void AddCollider(Circle& collider)
+    {
+        m_circleColliders.push_back(&collider);
+        m_circleBvhValid = false;
+    }
+
+    void RemoveCollider(Circle& collider)
+    {
+        for (size_t i = 0; i < m_circleColliders.size(); ++i)
+        {
+            if (m_circleColliders[i] == &collider)
+            {
+                m_circleColliders[i] = m_circleColliders.back();
+                m_circleColliders.pop_back();
+                m_circleBvhValid = false;
+                return;
+            }
+        }
+    }
+
+    void AddForceGenerator(ForceGenerator& generator)
+    {
+        m_ForceGenerators.push_back(&generator);
+    }
+
+    void RemoveForceGenerator(ForceGenerator& generator)
+    {
+        for (size_t i = 0; i < m_ForceGenerators.size(); ++i)
+        {
+            if (m_ForceGenerators[i] == &generator)
+            {
+                m_ForceGenerators[i] = m_ForceGenerators.back();
+                m_ForceGenerators.pop_back();
+                return;
+            }
+        }
+    }
+
+    void AddSensor(RangeSensor& sensor)
+    {
+        m_Sensors.push_back(&sensor);
+    }
+
+    void RemoveSensor(RangeSensor& sensor)
+    {
+        for (size_t i = 0; i < m_Sensors.size(); ++i)
+        {
+            if (m_Sensors[i] == &sensor)
+            {
+                m_Sensors[i] = m_Sensors.back();
+                m_Sensors.pop_back();
+                return;
+            }
+        }
+    }
+
+    // Casts numRays rays from a common origin, with unit directions (dirX[i], dirY[i]).
+    // Writes the distance to the closest circle or kinematic box into ranges, or maxRange if nothing was hit.
+    // Circles containing the origin are ignored, so sensors don't see the body they're attached to.
+    void CastRays(const Vec2f& origin, const float* dirX, const float* dirY, int numRays, float maxRange, float* ranges) const
+    {
+        assert(!m_KinematicBvhDirty);
+
+        // Kinematic boxes, through the BVH
+        const Vec3f origin3(origin.x(), origin.y(), 0.f);
+        for (int i = 0; i < numRays; ++i)
+        {
+            float t;
+            bool hit = m_KinematicBvh.raycast(math::Ray(origin3, Vec3f(dirX[i], dirY[i], 0.f)), maxRange, t) >= 0;
+            ranges[i] = hit ? t : maxRange;
+        }
+
+        // Circles, as wide as the CPU allows
+        static const RayCircleKernel rayCircle = math::pickKernel<RayCircleKernel>(
+            rayCircleScalar, rayCircleSse2, rayCircleAvx2, rayCircleAvx512);
+        auto castAt = [&](const Circle* circle) {
+            const Vec2f relPos = origin - circle->m_pos;
+            const float c = relPos.sqNorm() - circle->m_radius * circle->m_radius;
+            if (c <= 0)
+                return; // Origin inside the circle
+            const float distance = relPos.norm() - circle->m_radius;
+            if (distance > maxRange)
+                return;
+
+            rayCircle(relPos.x(), relPos.y(), c, dirX, dirY, numRays, ranges);
+        };
+
+        // Only circles whose box overlaps the range of the scan can be hit. The boxes are from the
+        // start of the step, so the range grows by how far circles have moved since.
+        if (!m_circleBvhValid)
+        {
+            for (auto circle : m_circleColliders)
+                castAt(circle);
+            return;
+        }
+        m_circleBvh.querySphere(origin3, maxRange + m_circleBvhSlack, [&](int i) {
+            castAt(m_circleColliders[i]);
+        });
+    }
+
+    void AddConstraint(Constraint& constraint)
+    {
+        m_Constraints.push_back(&constraint);
+    }
+
+    void RemoveConstraint(Constraint& constraint)
+    {
+        for (size_t i = 0; i < m_Constraints.size(); ++i)
+        {
+            if (m_Constraints[i] == &constraint)
+            {
+                m_Constraints[i] = m_Constraints.back();
+                m_Constraints.pop_back();
+                return;
+            }
+        }
+    }
+
+    void Update(float dt)
+    {
+        // Update simulation
+        m_stepResidual += dt;
+        int numSteps = 0;
+        while (m_stepResidual >= m_fixedStepSize && numSteps < m_maxSubsteps)
+        {
+            m_stepResidual -= m_fixedStepSize;
+            Step();
+            ++numSteps;
+        }
+
+        // Stepping more would only make the next frame slower. Drop whole steps we couldn't afford, but keep the fraction
+        m_lastDroppedTime = 0;
+        if (m_stepResidual >= m_fixedStepSize)
+        {
+            m_lastDroppedTime = std::floor(m_stepResidual / m_fixedStepSize) * m_fixedStepSize;
+            m_stepResidual -= m_lastDroppedTime;
+            m_totalDroppedTime += m_lastDroppedTime;
+        }
+    }
+
+    // Fraction of a step between the last two simulated states that corresponds to the current time
+    float InterpolationAlpha() const
+    {
+        return math::clamp(m_stepResidual / m_fixedStepSize, 0.f, 1.f);
+    }
+
+    float LastDroppedTime() const { return m_lastDroppedTime; }
+    float TotalDroppedTime() const { return m_totalDroppedTime; }
+
+    float m_fixedStepSize = 0.01f;
+    int m_maxSubsteps = 8; // Per call to Update
+
+    // Profiling. Off by default to keep clock reads out of the step.
+    bool m_profilePhases = false;
+    PhaseTimings m_timings;
+
+private:
+    // Bodies moving further than their radius in a single step could tunnel through thin obstacles.
+    // For those, pull them back to the first time of impact along the step and remove the approaching velocity.
+    void AdvanceConservatively(RigidBody& body, const Vec2f& startPos)
+    {
+        const Circle& collider = *body.m_Collider;
+        const float r = collider.m_radius;
+        const Vec2f displacement = body.m_Position - startPos;
+        if (displacement.sqNorm() <= r * r)
+            return;
+
+        float minToi = 1;
+        Vec2f hitNormal;
+        bool hit = false;
+        float toi;
+        Vec2f normal;
+
+        // Only boxes overlapping the circle that bounds the whole sweep can be hit
+        const Vec2f sweepCenter = startPos + 0.5f * displacement;
+        const float sweepRadius = 0.5f * displacement.norm() + r;
+        m_KinematicBvh.querySphere(Vec3f(sweepCenter.x(), sweepCenter.y(), 0.f), sweepRadius, [&](int i) {
+            if (sweep(startPos, r, displacement, *m_KinematicBodies[i], toi, normal) && toi < minToi)
+            {
+                minToi = toi;
+                hitNormal = normal;
+                hit = true;
+            }
+        });
+        // Other circles are considered static during the step
+        m_circleBvh.querySphere(Vec3f(sweepCenter.x(), sweepCenter.y(), 0.f), sweepRadius, [&](int i) {
+            const Circle* circle = m_circleColliders[i];
+            if (circle != &collider && sweep(startPos, r, displacement, *circle, toi, normal) && toi < minToi)
+            {
+                minToi = toi;
+                hitNormal = normal;
+                hit = true;
+            }
+        });
+
+        if (!hit)
+            return;
+
+        body.m_Position = startPos + minToi * displacement;
+        float approachSpeed = dot(body.m_LinearVelocity, hitNormal);
+        if (approachSpeed < 0)
+            body.m_LinearVelocity -= approachSpeed * hitNormal;
+        body.m_Collider->m_Colliding = true;
+    }
+
+    void RebuildKinematicBvh()
+    {
+        std::vector<math::AABB> boxes;
+        boxes.reserve(m_KinematicBodies.size());
+        for (auto body : m_KinematicBodies)
+        {
+            boxes.emplace_back(
+                Vec3f(body->m_Min.x(), body->m_Min.y(), 0.f),
+                Vec3f(body->m_Max.x(), body->m_Max.y(), 0.f));
+        }
+        m_KinematicBvh.build(boxes.data(), boxes.size());
+        m_KinematicBvhDirty = false;
+    }
+
+    // Circles move every step, so this is rebuilt at the start of each one
+    void RebuildCircleBvh()
+    {
+        m_circleBoxes.clear();
+        for (auto circle : m_circleColliders)
+        {
+            const Vec3f extent(circle->m_radius, circle->m_radius, 0.f);
+            const Vec3f center(circle->m_pos.x(), circle->m_pos.y(), 0.f);
+            m_circleBoxes.emplace_back(center - extent, center + extent);
+        }
+        m_circleBvh.build(m_circleBoxes.data(), m_circleBoxes.size());
+        m_circleBvhValid = true;
+        m_circleBvhSlack = 0;
+    }
+
+    // How far circles moved since RebuildCircleBvh, so queries can grow by that much
+    void UpdateCircleBvhSlack()
+    {
+        float slack = 0;
+        for (size_t i = 0; i < m_circleBoxes.size(); ++i)
+        {
+            const Vec3f center = m_circleBoxes[i].origin();
+            slack = std::max(slack, (m_circleColliders[i]->m_pos - Vec2f(center.x(), center.y())).norm());
+        }
+        m_circleBvhSlack = slack;
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    // Adds the time since start to a phase's total, and restarts the clock
+    void EndPhase(double& phaseTotal, Clock::time_point& start)
+    {
+        if (!m_profilePhases)
+            return;
+        auto now = Clock::now();
+        phaseTotal += std::chrono::duration<double>(now - start).count();
+        start = now;
+    }
+
+    // Colliders attached to bodies follow them
+    void SyncColliders()
+    {
+        for (auto body : m_bodies)
+        {
+            if (body->m_Collider)
+                body->m_Collider->m_pos = body->m_Position;
+        }
+    }
+
+    void Step()
+    {
+        Clock::time_point phaseStart;
+        if (m_profilePhases)
+        {
+            phaseStart = Clock::now();
+            ++m_timings.numSteps;
+        }
+
+        // Clear collisions
+        for (auto collider : m_circleColliders)
+        {
+            collider->m_Colliding = false;
+        }
+
+        // Bodies may have been moved since the last step
+        SyncColliders();
+
+        // Detect collisions. The circle BVH is also the broadphase for the sweeps of fast bodies.
+        RebuildCircleBvh();
+        for (size_t i = 0; i < m_circleColliders.size(); ++i)
+        {
+            Circle& a = *m_circleColliders[i];
+            m_circleBvh.querySphere(Vec3f(a.m_pos.x(), a.m_pos.y(), 0.f), a.m_radius, [&](int j) {
+                Circle& b = *m_circleColliders[j];
+                if (size_t(j) > i && intersect(a, b))
+                {
+                    a.m_Colliding = true;
+                    b.m_Colliding = true;
+                }
+            });
+        }
+        if (m_KinematicBvhDirty)
+        {
+            RebuildKinematicBvh();
+        }
+        for (auto collider : m_circleColliders)
+        {
+            // The BVH query already performs the exact circle vs box test
+            const Vec3f center(collider->m_pos.x(), collider->m_pos.y(), 0.f);
+            m_KinematicBvh.querySphere(center, collider->m_radius, [collider](int) {
+                collider->m_Colliding = true;
+            });
+        }
+
+        EndPhase(m_timings.collision, phaseStart);
+
+        // Add gravity to every body
+        for (auto body : m_bodies)
+        {
+            if (body->m_InvMass > 0)
+                body->ApplyForce(Vec2f(0.f, -9.81 / body->m_InvMass));
+        }
+
+        // Apply custom force generators
+        for (auto generator : m_ForceGenerators)
+        {
+            generator->ApplyForces();
+        }
+
+        EndPhase(m_timings.forces, phaseStart);
+
+        // Apply constraints force generators
+        for (auto c : m_Constraints)
+        {
+            c->ApplyConstraintForce();
+        }
+
+        EndPhase(m_timings.constraints, phaseStart);
+
+        // Integrate trajectories
+        for (auto body : m_bodies)
+        {
+            body->ResetInterpolation();
+            Vec2f startPos = body->m_Position;
+            body->Integrate(m_fixedStepSize);
+
+            if (body->m_Collider)
+                AdvanceConservatively(*body, startPos);
+        }
+
+        // Clear forces
+        for (auto body : m_bodies)
+        {
+            body->ResetForces();
+        }
+
+        EndPhase(m_timings.integration, phaseStart);
+
+        // Sensors see the state at the end of the step, colliders included
+        SyncColliders();
+        if (!m_Sensors.empty())
+            UpdateCircleBvhSlack();
+        for (auto sensor : m_Sensors)
+        {
+            sensor->Update(*this, m_fixedStepSize);
+        }
+
+        EndPhase(m_timings.sensors, phaseStart);
+    }
+
+    float m_stepResidual = 0;
+    float m_lastDroppedTime = 0;
+    float m_totalDroppedTime = 0;
+    std::vector<RigidBody*> m_bodies;
+    std::vector<Circle*> m_circleColliders;
+    std::vector<KinematicAABB*> m_KinematicBodies;
+    math::BVH m_KinematicBvh; // Indices match m_KinematicBodies
+    bool m_KinematicBvhDirty = false;
+    math::BVH m_circleBvh; // Indices match m_circleColliders, positions at the start of the step
+    std::vector<math::AABB> m_circleBoxes;
+    bool m_circleBvhValid = false; // Colliders weren't added or removed since the last build
+    float m_circleBvhSlack = 0; // Largest distance a circle moved since the last build
+    std::vector<ForceGenerator*> m_ForceGenerators;
+    std::vector<Constraint*> m_Constraints;
+    std::vector<RangeSensor*> m_Sensors;
+};
+
+inline void RangeSensor::Scan(const RigidBodyWorld& world)
+{
+    // Sensor pose in world space
+    const float angle = m_body->m_Angle + m_mountAngle;
+    const float cosA = cos(angle);
+    const float sinA = sin(angle);
+    const float cosB = cos(m_body->m_Angle);
+    const float sinB = sin(m_body->m_Angle);
+    const Vec2f origin = m_body->m_Position + Vec2f(
+        cosB * m_mountOffset.x() - sinB * m_mountOffset.y(),
+        sinB * m_mountOffset.x() + cosB * m_mountOffset.y());
+
+    const int n = numBeams();
+    for (int i = 0; i < n; ++i)
+    {
+        m_dirX[i] = cosA * m_localDirX[i] - sinA * m_localDirY[i];
+        m_dirY[i] = sinA * m_localDirX[i] + cosA * m_localDirY[i];
+    }
+
+    world.CastRays(origin, m_dirX.data(), m_dirY.data(), n, m_maxRange, m_ranges.data());
+
+    // Corrupt the measurements
+    m_numHits = 0;
+    const uint64_t counter0 = m_scanCount * n;
+    for (int i = 0; i < n; ++i)
+    {
+        float& r = m_ranges[i];
+        if (r >= m_maxRange || uniformNoise(counter0 + i) < m_dropoutProbability)
+        {
+            r = m_maxRange;
+            continue;
+        }
+        r = std::max(0.f, std::min(m_maxRange, r + m_rangeNoise * gaussianNoise(counter0 + i)));
+        m_hitX[m_numHits] = origin.x() + r * m_dirX[i];
+        m_hitY[m_numHits] = origin.y() + r * m_dirY[i];
+        ++m_numHits;
+    }
+    ++m_scanCount;
+}
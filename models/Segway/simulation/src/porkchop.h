@@ -0,0 +1,149 @@
+#pragma once
+// Porkchop plots: launch energy and arrival excess speed of every direct transfer in a grid of
+// departure and arrival dates. Body states come from Chebyshev ephemerides, and rows of the grid
+// are solved in parallel, one Lambert problem per cell.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "ephemeris.h"
+#include "lambert.h"
+
+struct PorkchopGrid
+{
+	// Dates in seconds since J2000
+	double departureStart = 0;
+	double departureStep = 0;
+	double arrivalStart = 0;
+	double arrivalStep = 0;
+	int numDepartures = 0;
+	int numArrivals = 0;
+
+	// One row per arrival date, one column per departure date.
+	// Infinity where the arrival isn't after the departure or the solver failed.
+	std::vector<float> c3; // Departure C3, km^2/s^2
+	std::vector<float> arrivalVInf; // Hyperbolic excess speed at arrival, km/s
+
+	double departure(int i) const { return departureStart + i * departureStep; }
+	double arrival(int j) const { return arrivalStart + j * arrivalStep; }
+	size_t index(int departure, int arrival) const { return size_t(arrival) * numDepartures + departure; }
+
+	// Layout, little endian: "PORK", version, numDepartures, numArrivals (uint32), departure start
+	// and step, arrival start and step (double), then the c3 and arrivalVInf grids (float).
+	bool save(const char* fileName) const
+	{
+		FILE* file = fopen(fileName, "wb");
+		if (!file)
+			return false;
+		const uint32_t header[4] = { kMagic, kVersion, uint32_t(numDepartures), uint32_t(numArrivals) };
+		const double dates[4] = { departureStart, departureStep, arrivalStart, arrivalStep };
+		bool ok = fwrite(header, sizeof(header), 1, file) == 1
+			&& fwrite(dates, sizeof(dates), 1, file) == 1
+			&& fwrite(c3.data(), sizeof(float), c3.size(), file) == c3.size()
+			&& fwrite(arrivalVInf.data(), sizeof(float), arrivalVInf.size(), file) == arrivalVInf.size();
+		ok = fclose(file) == 0 && ok;
+		return ok;
+	}
+
+	bool load(const char* fileName)
+	{
+		FILE* file = fopen(fileName, "rb");
+		if (!file)
+			return false;
+		uint32_t header[4];
+		double dates[4];
+		bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == kMagic && header[1] == kVersion
+			&& fread(dates, sizeof(dates), 1, file) == 1;
+		if (ok)
+		{
+			const size_t size = size_t(header[2]) * header[3];
+			c3.resize(size);
+			arrivalVInf.resize(size);
+			ok = fread(c3.data(), sizeof(float), size, file) == size
+				&& fread(arrivalVInf.data(), sizeof(float), size, file) == size;
+		}
+		fclose(file);
+		if (!ok)
+		{
+			*this = {};
+			return false;
+		}
+		numDepartures = int(header[2]);
+		numArrivals = int(header[3]);
+		departureStart = dates[0];
+		departureStep = dates[1];
+		arrivalStart = dates[2];
+		arrivalStep = dates[3];
+		return true;
+	}
+
+private:
+	static constexpr uint32_t kMagic = 0x4b524f50; // "PORK"
+	static constexpr uint32_t kVersion = 1;
+};
+
+// Transfers from origin to target around a body with gravitational parameter mu.
+// Date ranges are inclusive. numThreads = 0 uses every hardware thread.
+inline PorkchopGrid computePorkchop(
+	const ChebyshevEphemeris& origin, const ChebyshevEphemeris& target, double mu,
+	double departureStart, double departureEnd, int numDepartures,
+	double arrivalStart, double arrivalEnd, int numArrivals,
+	unsigned numThreads = 0)
+{
+	assert(numDepartures > 0 && numArrivals > 0);
+	PorkchopGrid grid;
+	grid.numDepartures = numDepartures;
+	grid.numArrivals = numArrivals;
+	grid.departureStart = departureStart;
+	grid.arrivalStart = arrivalStart;
+	grid.departureStep = numDepartures > 1 ? (departureEnd - departureStart) / (numDepartures - 1) : 0;
+	grid.arrivalStep = numArrivals > 1 ? (arrivalEnd - arrivalStart) / (numArrivals - 1) : 0;
+	grid.c3.resize(size_t(numDepartures) * numArrivals);
+	grid.arrivalVInf.resize(grid.c3.size());
+
+	// Body states, once per date
+	std::vector<math::Vec2d> r1(numDepartures), v1(numDepartures), r2(numArrivals), v2(numArrivals);
+	for (int i = 0; i < numDepartures; ++i)
+		origin.state(grid.departure(i), r1[i], v1[i]);
+	for (int j = 0; j < numArrivals; ++j)
+		target.state(grid.arrival(j), r2[j], v2[j]);
+
+	// Threads pick arrival rows from a shared counter, since rows with short flights are cheaper
+	std::atomic<int> nextRow = 0;
+	auto worker = [&]() {
+		constexpr float kInvalid = std::numeric_limits<float>::infinity();
+		for (int j = nextRow++; j < numArrivals; j = nextRow++)
+		{
+			for (int i = 0; i < numDepartures; ++i)
+			{
+				const size_t cell = grid.index(i, j);
+				const auto sol = lambert::solve(r1[i], r2[j], grid.arrival(j) - grid.departure(i), mu);
+				if (!sol.valid)
+				{
+					grid.c3[cell] = kInvalid;
+					grid.arrivalVInf[cell] = kInvalid;
+					continue;
+				}
+				grid.c3[cell] = float((sol.v1 - v1[i]).sqNorm() * 1e-6);
+				grid.arrivalVInf[cell] = float((sol.v2 - v2[j]).norm() * 1e-3);
+			}
+		}
+	};
+
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	numThreads = std::min(numThreads, unsigned(numArrivals));
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < numThreads; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& t : threads)
+		t.join();
+
+	return grid;
+}
@@ -6,6 +6,7 @@
 #include "app.h"
 #include <math/noise.h>
 #include <math/vector.h>
+#include <math/fastTrig.h>
 #include <math/matrix.h>
 #include <numbers>
 #include <random>
@@ -13,6 +14,10 @@
 static constexpr auto Pi = std::numbers::pi_v<double>;
 static constexpr auto TwoPi = 2 * std::numbers::pi_v<double>;
 
+// Set to true to run the model on the polynomial approximations in math/fastTrig.h instead of libm
+static constexpr bool kFastTrig = false;
+using ModelTrig = math::Trig<kFastTrig>;
+
 using namespace math;
 
 class AcrobotApp : public App
@@ -141,9 +146,9 @@ private:
         {
             auto T1 = 0.5 * I1 * pow(q1, 2);
             auto T2 =
-                (m2 * pow(l1, 2) + I2 + 2 * m2 * l1 * l2 * cos(q2)) * pow(dq1, 2) / 2
+                (m2 * pow(l1, 2) + I2 + 2 * m2 * l1 * l2 * ModelTrig::cos(q2)) * pow(dq1, 2) / 2
                 + I2 * pow(dq2, 2) / 2
-                + (I2 + m2 * l1 * l2 * cos(q2)) * dq1 * dq2;
+                + (I2 + m2 * l1 * l2 * ModelTrig::cos(q2)) * dq1 * dq2;
 
             return T1+T2;
         }
@@ -155,18 +160,19 @@ private:
         )
         {
             auto q1_q2 = q1 + q2;
-            auto cq1 = cos(q1);
-            auto cq2 = cos(q1_q2);
+            auto cq1 = ModelTrig::cos(q1);
+            auto cq2 = ModelTrig::cos(q1_q2);
             return -m1 * g * l1 * cq1 - m2 * g * (l1 * cq1 + l2 * cq2);
         }
 
         // Manipulator equations
         Mat22d M(Vec2d q)
         {
+            auto c2 = ModelTrig::cos(q[1]);
             return Mat22d(
-                p.I1 + p.I2 + p.m2 * pow(p.l1, 2) + 2 * p.m2 * p.l1 * p.l2 * cos(q[2]),
-                p.I2 + p.m2 * p.l1 * p.l2 * cos(q[2]),
-                p.I2 + p.m2*p.l1*p.l2*cos(q[2]),
+                p.I1 + p.I2 + p.m2 * pow(p.l1, 2) + 2 * p.m2 * p.l1 * p.l2 * c2,
+                p.I2 + p.m2 * p.l1 * p.l2 * c2,
+                p.I2 + p.m2*p.l1*p.l2*c2,
                 p.I2
             );
         }
@@ -204,10 +210,13 @@ private:
     void plotPendulum()
     {
         plotCircle<20>("Origin", 0, 0, 0.1f);
-        double x1 = m_acrobot.p.l1 * sin(m_acrobot.x.q1);
-        double y1 = -m_acrobot.p.l1 * cos(m_acrobot.x.q1);
-        double x2 = x1 + m_acrobot.p.l2 * sin(m_acrobot.x.q1 + m_acrobot.x.q2);
-        double y2 = y1 - m_acrobot.p.l2 * cos(m_acrobot.x.q1 + m_acrobot.x.q2);
+        double s1, c1, s12, c12;
+        ModelTrig::sincos(m_acrobot.x.q1, s1, c1);
+        ModelTrig::sincos(m_acrobot.x.q1 + m_acrobot.x.q2, s12, c12);
+        double x1 = m_acrobot.p.l1 * s1;
+        double y1 = -m_acrobot.p.l1 * c1;
+        double x2 = x1 + m_acrobot.p.l2 * s12;
+        double y2 = y1 - m_acrobot.p.l2 * c12;
         plotLine("l1", { 0, 0 }, { x1, y1 });
         plotLine("l2", { x1, y1 }, { x2, y2 });
         plotCircle<20>("End point", x2, y2, 0.1f);
@@ -222,9 +231,10 @@ private:
         float y[numSegments + 1];
         for (int i = 0; i < numSegments + 1; ++i)
         {
-            auto theta = i * TwoPi / numSegments;
-            x[i] = radius * cos(theta) + x0;
-            y[i] = radius * sin(theta) + y0;
+            double s, c;
+            ModelTrig::sincos(i * TwoPi / numSegments, s, c);
+            x[i] = float(radius * c + x0);
+            y[i] = float(radius * s + y0);
         }
         ImPlot::PlotLine(name, x, y, numSegments + 1);
     }
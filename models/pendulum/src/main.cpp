@@ -5,13 +5,19 @@
 #include <cmath>
 #include "app.h"
 #include <math/vector.h>
+#include <math/fastTrig.h>
 #include <math/matrix.h>
+#include <math/noise.h>
 #include <numbers>
 #include <random>
 
 static constexpr auto Pi = std::numbers::pi_v<double>;
 static constexpr auto TwoPi = 2 * std::numbers::pi_v<double>;
 
+// Set to true to run the simulation on the polynomial approximations in math/fastTrig.h instead of libm
+static constexpr bool kFastTrig = false;
+using ModelTrig = math::Trig<kFastTrig>;
+
 using namespace math;
 
 struct Pendulum
@@ -250,7 +256,7 @@ private:
 
             // Current energy
             auto T = 0.5 * p.m1 * p.l1 * p.l1 * x.dTheta * x.dTheta;
-            auto V = p.m1 * g * p.l1 * -cos(x.theta);
+            auto V = p.m1 * g * p.l1 * -ModelTrig::cos(x.theta);
             auto E = T + V;
 
             // Choose control method
@@ -260,7 +266,7 @@ private:
             if (torqueLimited)
             {
                 auto minCos = p.MaxQ / mgl;
-                if (-cos(x.theta) <= minCos)
+                if (-ModelTrig::cos(x.theta) <= minCos)
                     pumpEnergy = true;
             }
 
@@ -293,7 +299,7 @@ private:
         auto u = computeControllerInput();
 
         auto b = m_pendulumParams.b1;
-        auto torque = u -params.b1 * x.dTheta - sin(x.theta) * g * params.l1;
+        auto torque = u -params.b1 * x.dTheta - ModelTrig::sin(x.theta) * g * params.l1;
 
         const auto invInertia = m_pendulumParams.I1 > 0 ? (1 / m_pendulumParams.I1) : 0;
         auto ddq = torque * invInertia;
@@ -304,44 +310,15 @@ private:
 
     static constexpr auto g = 9.81;
 
-    static int squirrelNoise(int position, int seed = 0)
-    {
-        constexpr unsigned int BIT_NOISE1 = 0xB5297A4D;
-        constexpr unsigned int BIT_NOISE2 = 0x68E31DA4;
-        constexpr unsigned int BIT_NOISE3 = 0x1B56C4E9;
-
-        int mangled = position;
-        mangled *= BIT_NOISE1;
-        mangled += seed;
-        mangled ^= (mangled >> 8);
-        mangled *= BIT_NOISE2;
-        mangled ^= (mangled << 8);
-        mangled *= BIT_NOISE3;
-        mangled ^= (mangled >> 8);
-        return mangled;
-    }
-
-    struct squirrelRng
-    {
-        int rand()
-        {
-            return squirrelNoise(state++);
-        }
-
-        float uniform()
-        {
-            auto i = rand();
-            return float(i & ((1 << 24) - 1)) / (1 << 24);
-        }
-
-        int state = 0;
-    } m_rng;
+    math::SquirrelRng m_rng{ -1 }; // Pre-increments, so the sequence still starts at position 0
 
     void plotPendulum()
     {
         plotCircle<20>("Origin", 0, 0, 0.1f);
-        double x = m_pendulumParams.l1 * sin(m_pendulumState.theta);
-        double y = -m_pendulumParams.l1 * cos(m_pendulumState.theta);
+        double s, c;
+        ModelTrig::sincos(m_pendulumState.theta, s, c);
+        double x = m_pendulumParams.l1 * s;
+        double y = -m_pendulumParams.l1 * c;
         plotLine("axis", { 0, 0 }, { x, y });
         plotCircle<20>("End point", x, y, 0.1f);
     }
@@ -355,9 +332,10 @@ private:
         float y[numSegments + 1];
         for (int i = 0; i < numSegments + 1; ++i)
         {
-            auto theta = i * TwoPi / numSegments;
-            x[i] = radius * cos(theta) + x0;
-            y[i] = radius * sin(theta) + y0;
+            double s, c;
+            ModelTrig::sincos(i * TwoPi / numSegments, s, c);
+            x[i] = float(radius * c + x0);
+            y[i] = float(radius * s + y0);
         }
         ImPlot::PlotLine(name, x, y, numSegments + 1);
     }